@@ -0,0 +1,226 @@
+// CSG.cpp
+
+#include "include/CSG.h"
+
+#include <cctype>
+#include <openvdb/tools/Composite.h>
+#include <tbb/parallel_invoke.h>
+
+// Combines two grids without touching either; the result shares no nodes with them
+openvdb::FloatGrid::Ptr csgCombine(CSGOperation operation, const openvdb::FloatGrid& a, const openvdb::FloatGrid& b) {
+    switch (operation) {
+        case CSGOperation::Union:
+            return openvdb::tools::csgUnionCopy(a, b);
+        case CSGOperation::Intersection:
+            return openvdb::tools::csgIntersectionCopy(a, b);
+        case CSGOperation::Difference:
+        default:
+            return openvdb::tools::csgDifferenceCopy(a, b);
+    }
+}
+
+// Combines two grids in place: the result is left in a, and b is emptied.
+// Both must have the same transform.
+static void csgCombineInPlace(CSGOperation operation, openvdb::FloatGrid& a, openvdb::FloatGrid& b) {
+    switch (operation) {
+        case CSGOperation::Union:
+            openvdb::tools::csgUnion(a, b);
+            break;
+        case CSGOperation::Intersection:
+            openvdb::tools::csgIntersection(a, b);
+            break;
+        case CSGOperation::Difference:
+            openvdb::tools::csgDifference(a, b);
+            break;
+    }
+}
+
+// Recursive descent over
+//     expression := term (('|' | '-') term)*
+//     term       := factor ('&' factor)*
+//     factor     := NAME | '(' expression ')'
+// so that a | b & c means a | (b & c), and | and - associate to the left.
+namespace {
+struct CSGParser {
+    const string& text;
+    size_t pos = 0;
+    string& error;
+
+    char peek() {
+        while (pos < text.size() && isspace(static_cast<unsigned char>(text[pos]))) {
+            pos++;
+        }
+        return pos < text.size() ? text[pos] : '\0';
+    }
+
+    static bool isNameChar(char c) {
+        return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.';
+    }
+
+    unique_ptr<CSGExpression> combine(CSGOperation operation, unique_ptr<CSGExpression> left, unique_ptr<CSGExpression> right) {
+        auto node = make_unique<CSGExpression>();
+        node->operation = operation;
+        node->left = move(left);
+        node->right = move(right);
+        return node;
+    }
+
+    unique_ptr<CSGExpression> factor() {
+        char c = peek();
+        if (c == '(') {
+            pos++;
+            unique_ptr<CSGExpression> inner = expression();
+            if (!inner) {
+                return nullptr;
+            }
+            if (peek() != ')') {
+                error = "missing ')' at column " + to_string(pos + 1);
+                return nullptr;
+            }
+            pos++;
+            return inner;
+        }
+        size_t start = pos;
+        while (pos < text.size() && isNameChar(text[pos])) {
+            pos++;
+        }
+        if (pos == start) {
+            error = c == '\0' ? "expression ends early" : "unexpected '" + string(1, c) + "' at column " + to_string(pos + 1);
+            return nullptr;
+        }
+        auto leaf = make_unique<CSGExpression>();
+        leaf->grid = text.substr(start, pos - start);
+        return leaf;
+    }
+
+    unique_ptr<CSGExpression> term() {
+        unique_ptr<CSGExpression> left = factor();
+        while (left && peek() == '&') {
+            pos++;
+            unique_ptr<CSGExpression> right = factor();
+            if (!right) {
+                return nullptr;
+            }
+            left = combine(CSGOperation::Intersection, move(left), move(right));
+        }
+        return left;
+    }
+
+    unique_ptr<CSGExpression> expression() {
+        unique_ptr<CSGExpression> left = term();
+        for (char c = peek(); left && (c == '|' || c == '-'); c = peek()) {
+            pos++;
+            unique_ptr<CSGExpression> right = term();
+            if (!right) {
+                return nullptr;
+            }
+            left = combine(c == '|' ? CSGOperation::Union : CSGOperation::Difference, move(left), move(right));
+        }
+        return left;
+    }
+};
+}
+
+// Parses e.g. "(substrate | oxide) - trench & mask". Returns null and sets error on bad input.
+unique_ptr<CSGExpression> parseCSGExpression(const string& text, string& error) {
+    CSGParser parser{text, 0, error};
+    unique_ptr<CSGExpression> expression = parser.expression();
+    if (expression && parser.peek() != '\0') {
+        error = "unexpected '" + string(1, parser.peek()) + "' at column " + to_string(parser.pos + 1);
+        return nullptr;
+    }
+    return expression;
+}
+
+// Appends the grid names of the leaves, left to right
+void csgGridNames(const CSGExpression& expression, vector<string>& names) {
+    if (expression.isLeaf()) {
+        names.push_back(expression.grid);
+        return;
+    }
+    csgGridNames(*expression.left, names);
+    csgGridNames(*expression.right, names);
+}
+
+// Intermediate result: either a looked-up grid, which must not be modified,
+// or one produced here, which the parent may consume in place
+struct CSGValue {
+    openvdb::FloatGrid::ConstPtr input;
+    openvdb::FloatGrid::Ptr owned;
+
+    const openvdb::FloatGrid& grid() const { return owned ? *owned : *input; }
+};
+
+static CSGValue combineValues(CSGOperation operation, CSGValue& left, CSGValue& right) {
+    // Both operands are scratch: reuse the left tree rather than copying. The
+    // in-place operations only see the trees, so operands on different
+    // transforms (voxel sizes) take the copy path, which resamples the right one.
+    if (left.owned && right.owned && left.owned->transform() == right.owned->transform()) {
+        csgCombineInPlace(operation, *left.owned, *right.owned);
+        right.owned.reset();
+        return {nullptr, move(left.owned)};
+    }
+    CSGValue result{nullptr, csgCombine(operation, left.grid(), right.grid())};
+    // Free scratch operands right away, so a reduction that had to resample
+    // still holds only about log2(n) partial grids per worker
+    left.owned.reset();
+    right.owned.reset();
+    return result;
+}
+
+static CSGValue evaluateNode(const CSGExpression& node, const GridLookup& lookup) {
+    if (node.isLeaf()) {
+        return {lookup(node.grid), nullptr};
+    }
+    CSGValue left, right;
+    tbb::parallel_invoke([&] { left = evaluateNode(*node.left, lookup); },
+                         [&] { right = evaluateNode(*node.right, lookup); });
+    return combineValues(node.operation, left, right);
+}
+
+// Evaluates the whole expression in one pass. Input grids are shared, never
+// copied or modified; only the intermediate results are allocated, and sibling
+// subexpressions run in parallel.
+openvdb::FloatGrid::Ptr evaluateCSG(const CSGExpression& expression, const GridLookup& lookup) {
+    CSGValue result = evaluateNode(expression, lookup);
+    return result.owned ? result.owned : result.input->deepCopy();
+}
+
+// Balanced reduction of leaves [begin, end). Halves run in parallel and each
+// partial result is merged as soon as both halves are done, so only about
+// log2(n) partial grids per worker are alive at once.
+static CSGValue reduceRange(CSGOperation operation, size_t begin, size_t end, const function<CSGValue(size_t)>& leaf) {
+    if (end - begin == 1) {
+        return leaf(begin);
+    }
+    size_t middle = begin + (end - begin) / 2;
+    CSGValue left, right;
+    tbb::parallel_invoke([&] { left = reduceRange(operation, begin, middle, leaf); },
+                         [&] { right = reduceRange(operation, middle, end, leaf); });
+    return combineValues(operation, left, right);
+}
+
+// Union or intersection of many grids as a balanced tree instead of a chain
+// of ever-growing operands. The inputs are left untouched. Every merge keeps
+// the transform of its left operand, so the result is on the first grid's
+// transform and grids of other voxel sizes are resampled onto it.
+openvdb::FloatGrid::Ptr csgReduce(CSGOperation operation, const vector<openvdb::FloatGrid::ConstPtr>& grids) {
+    if (grids.empty()) {
+        return nullptr;
+    }
+    CSGValue result = reduceRange(operation, 0, grids.size(), [&](size_t i) {
+        return CSGValue{grids[i], nullptr};
+    });
+    return result.owned ? result.owned : result.input->deepCopy();
+}
+
+// Same, over grids that makeGrid(i) creates on demand; they are merged in
+// place and freed as the reduction goes, so they never all exist at once
+openvdb::FloatGrid::Ptr csgReduce(CSGOperation operation, size_t numGrids, const GridSource& makeGrid) {
+    if (numGrids == 0) {
+        return nullptr;
+    }
+    return reduceRange(operation, 0, numGrids, [&](size_t i) {
+        return CSGValue{nullptr, makeGrid(i)};
+    }).owned;
+}
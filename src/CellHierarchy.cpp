@@ -0,0 +1,191 @@
+// CellHierarchy.cpp
+
+#include "include/CellHierarchy.h"
+
+// Placement of an SREF/AREF at its first XY point
+static Transform2D referenceTransform(const GDSIIElement* element, double unit) {
+    double magnification = element->Mag != 0 ? element->Mag : 1.0;
+    return placementTransform(element->Angle, magnification, element->Refl, element->XY[0] * unit, element->XY[1] * unit);
+}
+
+// Fills subtreeLayers bottom-up. A reference cycle makes the hierarchy
+// infinite, so it aborts like any other unreadable file.
+static void collectSubtreeLayers(CellHierarchy& hierarchy, int cellIndex, vector<int>& state) {
+    if (state[cellIndex] == 2) {
+        return;
+    }
+    Cell& cell = hierarchy.cells[cellIndex];
+    if (state[cellIndex] == 1) {
+        printf("error: cell %s references itself (aborting)\n", cell.name.c_str());
+        exit(1);
+    }
+    state[cellIndex] = 1;
+    for (const auto& layerPair : cell.layers) {
+        cell.subtreeLayers.insert(layerPair.first);
+    }
+    for (const CellReference& reference : cell.references) {
+        collectSubtreeLayers(hierarchy, reference.cell, state);
+        const set<int>& childLayers = hierarchy.cells[reference.cell].subtreeLayers;
+        cell.subtreeLayers.insert(childLayers.begin(), childLayers.end());
+    }
+    state[cellIndex] = 2;
+}
+
+// Reads every structure of the GDS file once, with its BOUNDARY/BOX polygons
+// per layer and its SREF/AREF placements, instead of flattening the layout
+CellHierarchy extractHierarchy(GDSIIData* gdsIIData) {
+    CellHierarchy hierarchy;
+    const vector<GDSIIStruct*>& structs = gdsIIData->Structs;
+    double unit = gdsIIData->FileUnits[0];
+
+    map<string, int> cellIndices;
+    for (size_t ns = 0; ns < structs.size(); ns++) {
+        cellIndices[*structs[ns]->Name] = ns;
+    }
+
+    hierarchy.cells.resize(structs.size());
+    vector<bool> referenced(structs.size(), false);
+    for (size_t ns = 0; ns < structs.size(); ns++) {
+        Cell& cell = hierarchy.cells[ns];
+        cell.name = *structs[ns]->Name;
+        for (const GDSIIElement* element : structs[ns]->Elements) {
+            const iVec& xy = element->XY;
+            if (element->Type == BOUNDARY || element->Type == BOX) {
+                // The closing point repeats the first one
+                size_t numPoints = xy.size() / 2;
+                if (numPoints > 1 && xy[0] == xy[2 * numPoints - 2] && xy[1] == xy[2 * numPoints - 1]) {
+                    numPoints--;
+                }
+                ElementList2D& elementList = cell.layers[element->Layer];
+                for (size_t k = 0; k < numPoints; k++) {
+                    elementList.vertices.push_back({xy[2 * k] * unit, xy[2 * k + 1] * unit});
+                }
+                elementList.closeElement();
+            } else if ((element->Type == SREF || element->Type == AREF) && element->SName) {
+                auto it = cellIndices.find(*element->SName);
+                if (it == cellIndices.end()) {
+                    cerr << "Skipping reference to undefined cell " << *element->SName << " in " << cell.name << endl;
+                    continue;
+                }
+                CellReference reference;
+                reference.cell = it->second;
+                reference.transform = referenceTransform(element, unit);
+                if (element->Type == AREF && xy.size() >= 6 && element->Columns > 0 && element->Rows > 0) {
+                    reference.columns = element->Columns;
+                    reference.rows = element->Rows;
+                    reference.columnStep = {(xy[2] - xy[0]) * unit / reference.columns, (xy[3] - xy[1]) * unit / reference.columns};
+                    reference.rowStep = {(xy[4] - xy[0]) * unit / reference.rows, (xy[5] - xy[1]) * unit / reference.rows};
+                }
+                cell.references.push_back(reference);
+                referenced[reference.cell] = true;
+            }
+        }
+    }
+
+    vector<int> state(hierarchy.cells.size(), 0);
+    for (size_t ns = 0; ns < hierarchy.cells.size(); ns++) {
+        collectSubtreeLayers(hierarchy, ns, state);
+        if (!referenced[ns]) {
+            hierarchy.topCells.push_back(ns);
+        }
+    }
+    return hierarchy;
+}
+
+set<int> CellHierarchy::layers() const {
+    set<int> result;
+    for (int top : topCells) {
+        result.insert(cells[top].subtreeLayers.begin(), cells[top].subtreeLayers.end());
+    }
+    return result;
+}
+
+size_t CellHierarchy::uniquePolygonCount() const {
+    size_t count = 0;
+    for (const Cell& cell : cells) {
+        for (const auto& layerPair : cell.layers) {
+            count += layerPair.second.size();
+        }
+    }
+    return count;
+}
+
+// Polygons below a cell once every placement is expanded, memoized per cell
+static size_t placedPolygons(const CellHierarchy& hierarchy, int cellIndex, vector<size_t>& memo) {
+    if (memo[cellIndex] != SIZE_MAX) {
+        return memo[cellIndex];
+    }
+    const Cell& cell = hierarchy.cells[cellIndex];
+    size_t count = 0;
+    for (const auto& layerPair : cell.layers) {
+        count += layerPair.second.size();
+    }
+    for (const CellReference& reference : cell.references) {
+        count += static_cast<size_t>(reference.columns) * reference.rows * placedPolygons(hierarchy, reference.cell, memo);
+    }
+    return memo[cellIndex] = count;
+}
+
+size_t CellHierarchy::placedPolygonCount() const {
+    vector<size_t> memo(cells.size(), SIZE_MAX);
+    size_t count = 0;
+    for (int top : topCells) {
+        count += placedPolygons(*this, top, memo);
+    }
+    return count;
+}
+
+// Triangulates the polygons of every cell once
+TriangulationStats triangulateHierarchy(CellHierarchy& hierarchy, const TriangulationOptions& options) {
+    vector<ElementList2D*> elementLists;
+    for (Cell& cell : hierarchy.cells) {
+        for (auto& layerPair : cell.layers) {
+            elementLists.push_back(&layerPair.second);
+        }
+    }
+    return triangulateElementLists(elementLists, options);
+}
+
+// Extrudes the polygons of every cell once, emptying Cell::layers
+void extrudeHierarchy(CellHierarchy& hierarchy, double zMin, double zMax) {
+    for (Cell& cell : hierarchy.cells) {
+        cell.extrudedLayers = extrudePolygons(cell.layers, zMin, zMax);
+    }
+}
+
+static void expandPlacements(const CellHierarchy& hierarchy, int cellIndex, const Transform2D& transform, int layerNumber, const PLYInstanceVisitor& visit) {
+    const Cell& cell = hierarchy.cells[cellIndex];
+    if (cell.subtreeLayers.count(layerNumber) == 0) {
+        return;
+    }
+    auto it = cell.extrudedLayers.find(layerNumber);
+    if (it != cell.extrudedLayers.end()) {
+        visit(it->second, transform);
+    }
+    for (const CellReference& reference : cell.references) {
+        for (int column = 0; column < reference.columns; column++) {
+            for (int row = 0; row < reference.rows; row++) {
+                Transform2D placement = reference.transform;
+                placement.dx += column * reference.columnStep.x + row * reference.rowStep.x;
+                placement.dy += column * reference.columnStep.y + row * reference.rowStep.y;
+                expandPlacements(hierarchy, reference.cell, transform * placement, layerNumber, visit);
+            }
+        }
+    }
+}
+
+// Visits every placement of the extruded geometry of a layer, expanding the
+// hierarchy depth-first without storing the placements
+void forEachPlacement(const CellHierarchy& hierarchy, int layerNumber, const PLYInstanceVisitor& visit) {
+    for (int top : hierarchy.topCells) {
+        expandPlacements(hierarchy, top, Transform2D(), layerNumber, visit);
+    }
+}
+
+// Writes a layer of the hierarchy to a PLY file. PLY has no instancing, so
+// placements are expanded lazily while the file is streamed.
+size_t writeHierarchyPLY(const string& filename, const CellHierarchy& hierarchy, int layerNumber, PLYFormat format) {
+    return writePLYInstances(filename, [&](const PLYInstanceVisitor& visit) {
+        forEachPlacement(hierarchy, layerNumber, visit);
+    }, format);
+}
@@ -0,0 +1,173 @@
+// FastTriangulation.cpp
+
+#include "include/FastTriangulation.h"
+
+#include <array>
+#include "include/lib/predicates.h"
+
+// Sign of the turn a -> b -> c: 1 for counterclockwise, -1 for clockwise, 0 if collinear
+static int turnSign(const Vertex2D& a, const Vertex2D& b, const Vertex2D& c) {
+    double turn = predicates::adaptive::orient2d(a.x, a.y, b.x, b.y, c.x, c.y);
+    return (turn > 0) - (turn < 0);
+}
+
+// Database-unit coordinates are bounded by maxDatabaseCoordinate, so the turn
+// is exact in 64-bit integers
+static int turnSign(const VertexDB& a, const VertexDB& b, const VertexDB& c) {
+    int64_t turn = (int64_t(b.x) - a.x) * (int64_t(c.y) - a.y) - (int64_t(b.y) - a.y) * (int64_t(c.x) - a.x);
+    return (turn > 0) - (turn < 0);
+}
+
+// Counts sign changes of a cyclic sequence, ignoring zeros
+struct SignChangeCounter {
+    int first = 0, last = 0, changes = 0;
+
+    void add(double value) {
+        int sign = (value > 0) - (value < 0);
+        if (sign == 0) {
+            return;
+        }
+        if (last == 0) {
+            first = sign;
+        } else if (sign != last) {
+            changes++;
+        }
+        last = sign;
+    }
+    int total() const {
+        return changes + (first != 0 && last != first ? 1 : 0);
+    }
+};
+
+// Detects rectangles, strictly convex and rectilinear polygons. A polygon is
+// convex when every turn has the same sign and the boundary winds around once,
+// i.e. the x and y directions of its edges each flip exactly twice.
+template <typename VertexT>
+PolygonClass classifyPolygon(const VertexT* polygon, size_t numVertices) {
+    if (numVertices < 3) {
+        return PolygonClass::General;
+    }
+
+    bool rectilinear = true;
+    bool convex = true;
+    int orientation = 0;
+    SignChangeCounter xDirection, yDirection;
+    for (size_t i = 0; i < numVertices; i++) {
+        const VertexT& a = polygon[i];
+        const VertexT& b = polygon[(i + 1) % numVertices];
+        const VertexT& c = polygon[(i + 2) % numVertices];
+        if (a.x != b.x && a.y != b.y) {
+            rectilinear = false;
+        }
+        int sign = turnSign(a, b, c);
+        if (sign == 0 || (orientation != 0 && sign != orientation)) {
+            convex = false;
+        }
+        orientation = sign;
+        xDirection.add(b.x - a.x);
+        yDirection.add(b.y - a.y);
+    }
+
+    if (convex && xDirection.total() == 2 && yDirection.total() == 2) {
+        return rectilinear && numVertices == 4 ? PolygonClass::Rectangle : PolygonClass::Convex;
+    }
+    return rectilinear ? PolygonClass::Rectilinear : PolygonClass::General;
+}
+
+// Fans a strictly convex polygon from its first vertex. Triangles are emitted
+// counterclockwise like the CDT output, whatever the polygon orientation.
+template <typename VertexT>
+void triangulateConvex(const VertexT* polygon, size_t numVertices, TriangleList& triangles) {
+    bool counterclockwise = turnSign(polygon[0], polygon[1], polygon[2]) > 0;
+    for (int i = 1; i + 1 < static_cast<int>(numVertices); i++) {
+        if (counterclockwise) {
+            triangles.push_back({0, i, i + 1});
+        } else {
+            triangles.push_back({0, i + 1, i});
+        }
+    }
+}
+
+// Triangulates a simple polygon by clipping ears. Returns false, leaving
+// triangles untouched, when no valid ear is found (collinear runs, touching or
+// self-intersecting boundaries) so that the caller can fall back to the CDT.
+template <typename VertexT>
+bool triangulateByEarClipping(const VertexT* polygon, size_t numVertices, TriangleList& triangles) {
+    if (numVertices < 3 || numVertices > maxEarClippingVertices) {
+        return false;
+    }
+
+    // Twice the signed area gives the orientation that ears must share
+    typedef typename VertexTraits<VertexT>::Area Area;
+    Area area = 0;
+    for (size_t i = 0; i < numVertices; i++) {
+        const VertexT& a = polygon[i];
+        const VertexT& b = polygon[(i + 1) % numVertices];
+        area += Area(a.x) * b.y - Area(b.x) * a.y;
+    }
+    int orientation = (area > 0) - (area < 0);
+    if (orientation == 0) {
+        return false;
+    }
+
+    array<int, maxEarClippingVertices> prev, next;
+    for (int i = 0; i < static_cast<int>(numVertices); i++) {
+        prev[i] = (i + numVertices - 1) % numVertices;
+        next[i] = (i + 1) % numVertices;
+    }
+
+    size_t numTriangles = triangles.size();
+    size_t remaining = numVertices;
+    size_t sinceLastEar = 0;
+    int i = 0;
+    while (remaining > 3) {
+        int p = prev[i];
+        int q = next[i];
+        bool isEar = turnSign(polygon[p], polygon[i], polygon[q]) == orientation;
+        for (int j = next[q]; isEar && j != p; j = next[j]) {
+            // Vertices on the boundary of the candidate count as blocking
+            const VertexT& v = polygon[j];
+            isEar = turnSign(polygon[p], polygon[i], v) == -orientation ||
+                    turnSign(polygon[i], polygon[q], v) == -orientation ||
+                    turnSign(polygon[q], polygon[p], v) == -orientation;
+        }
+
+        if (isEar) {
+            if (orientation > 0) {
+                triangles.push_back({p, i, q});
+            } else {
+                triangles.push_back({q, i, p});
+            }
+            next[p] = q;
+            prev[q] = p;
+            remaining--;
+            sinceLastEar = 0;
+            i = q;
+        } else if (++sinceLastEar > remaining) {
+            triangles.resize(numTriangles);
+            return false;
+        } else {
+            i = q;
+        }
+    }
+
+    int p = prev[i];
+    int q = next[i];
+    if (turnSign(polygon[p], polygon[i], polygon[q]) != orientation) {
+        triangles.resize(numTriangles);
+        return false;
+    }
+    if (orientation > 0) {
+        triangles.push_back({p, i, q});
+    } else {
+        triangles.push_back({q, i, p});
+    }
+    return true;
+}
+
+template PolygonClass classifyPolygon(const Vertex2D*, size_t);
+template PolygonClass classifyPolygon(const VertexDB*, size_t);
+template void triangulateConvex(const Vertex2D*, size_t, TriangleList&);
+template void triangulateConvex(const VertexDB*, size_t, TriangleList&);
+template bool triangulateByEarClipping(const Vertex2D*, size_t, TriangleList&);
+template bool triangulateByEarClipping(const VertexDB*, size_t, TriangleList&);
@@ -1,6 +1,22 @@
 // GDSProcessor.cpp
 
 #include "include/GDSProcessor.h"
+#include "include/FastTriangulation.h"
+#include "include/RegionTriangulation.h"
+#include "include/SpatialIndex.h"
+#include "include/TriangulationCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <tbb/blocked_range.h>
+#include <tbb/global_control.h>
+#include <tbb/info.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
 
 // Reads GDS file and returns its data
 GDSIIData* readGDS(const char* gdsFileName) {
@@ -12,155 +28,588 @@ GDSIIData* readGDS(const char* gdsFileName) {
     return gdsIIData;
 }
 
+// Cosine and sine of a GDS rotation, exact for multiples of 90 degrees
+static void rotationCosSin(double degrees, double& c, double& s) {
+    double quarterTurns = degrees / 90.0;
+    if (quarterTurns == floor(quarterTurns)) {
+        static const double cosines[4] = {1, 0, -1, 0};
+        static const double sines[4] = {0, 1, 0, -1};
+        int quarter = static_cast<int>(fmod(quarterTurns, 4.0) + 4) % 4;
+        c = cosines[quarter];
+        s = sines[quarter];
+    } else {
+        c = cos(degrees * M_PI / 180.0);
+        s = sin(degrees * M_PI / 180.0);
+    }
+}
+
+// Placement of an SREF/AREF: reflection about x first, then magnification,
+// rotation and translation by (dx, dy)
+Transform2D placementTransform(double angle, double magnification, bool reflected, double dx, double dy) {
+    double c, s;
+    rotationCosSin(angle, c, s);
+    double reflection = reflected ? -1.0 : 1.0;
+
+    Transform2D transform;
+    transform.xx = c * magnification;
+    transform.xy = -s * magnification * reflection;
+    transform.yx = s * magnification;
+    transform.yy = c * magnification * reflection;
+    transform.dx = dx;
+    transform.dy = dy;
+    return transform;
+}
+
 // Extracts polygons from GDSData and returns a map from layer number to a polygon list
 map<int, PolygonList> extractPolygons(GDSIIData* gdsIIData) { 
     map<int, PolygonList> layerMap;
     vector<int> layers = gdsIIData->GetLayers();
-    for (int nl = 0; nl < layers.size(); nl++) {
-        PolygonList layerNLPolygons = gdsIIData->GetPolygons(layers[nl]);
-        layerMap[layers[nl]] = layerNLPolygons;
+    for (size_t nl = 0; nl < layers.size(); nl++) {
+        layerMap[layers[nl]] = gdsIIData->GetPolygons(layers[nl]);
     }
     return layerMap;
 }
 
-// Converts polygons in layerMap to Vertex2D representation
+// Converts polygons in layerMap to Vertex2D representation. Each layer's
+// PolygonList is released as soon as it has been moved into the flat store.
 map<int, ElementList2D> layerMapToElementList(map<int, PolygonList>& layerMap) {
+    // libGDSII polygons are interleaved x,y doubles, which is exactly the Vertex2D layout
+    static_assert(sizeof(Vertex2D) == 2 * sizeof(double), "Unexpected sizeof(Vertex2D)");
+
     map<int, ElementList2D> layerMap2D;
-    for (const auto& it : layerMap) {
+    for (auto& it : layerMap) {
         int layerNumber = it.first;
-        const PolygonList& polygons = it.second;
-        ElementList2D elementList;
+        PolygonList& polygons = it.second;
+        ElementList2D& elementList = layerMap2D[layerNumber];
+
+        size_t numVertices = 0;
         for (const auto& polygon : polygons) {
-            Polygon2D polygon2D;
-            for (int i = 0; i < polygon.size(); i += 2) {
-                double x = polygon[i];
-                double y = polygon[i + 1];
-                polygon2D.push_back(Vertex2D{x, y});
-            }
-            elementList.push_back({polygon2D, {}, false});
+            numVertices += polygon.size() / 2;
         }
-        layerMap2D[layerNumber] = elementList;
+        elementList.vertices.resize(numVertices);
+        elementList.vertexOffsets.reserve(polygons.size() + 1);
+        elementList.triangleOffsets.reserve(polygons.size() + 1);
+        elementList.clockwise.reserve(polygons.size());
+
+        size_t offset = 0;
+        for (const auto& polygon : polygons) {
+            memcpy(&elementList.vertices[offset], polygon.data(), polygon.size() / 2 * sizeof(Vertex2D));
+            offset += polygon.size() / 2;
+            elementList.vertexOffsets.push_back(offset);
+            elementList.triangleOffsets.push_back(0);
+            elementList.clockwise.push_back(false);
+        }
+        PolygonList().swap(polygons);
     }
     return layerMap2D;
 }
 
+// Extracts polygons from GDSData straight into database units, the integer
+// grid of the file. Layers are fetched one at a time, so only one layer's
+// double-precision PolygonList exists at once. libGDSII flattens placements in
+// user units, so each coordinate is snapped back to the grid; only placements
+// rotated off the axes or scaled leave vertices between grid points, and
+// those are reported.
+map<int, ElementListDB> extractElementListsDB(GDSIIData* gdsIIData) {
+    double unit = gdsIIData->FileUnits[0]; // user units per database unit
+    map<int, ElementListDB> layerMapDB;
+    size_t offGrid = 0;
+    for (int layerNumber : gdsIIData->GetLayers()) {
+        PolygonList polygons = gdsIIData->GetPolygons(layerNumber);
+        ElementListDB& elementList = layerMapDB[layerNumber];
+        elementList.unit = unit;
+
+        size_t numVertices = 0;
+        for (const auto& polygon : polygons) {
+            numVertices += polygon.size() / 2;
+        }
+        elementList.vertices.reserve(numVertices);
+        elementList.vertexOffsets.reserve(polygons.size() + 1);
+        elementList.triangleOffsets.reserve(polygons.size() + 1);
+        elementList.clockwise.reserve(polygons.size());
+
+        for (const auto& polygon : polygons) {
+            for (size_t k = 0; k < polygon.size(); k += 2) {
+                double x = polygon[k] / unit, y = polygon[k + 1] / unit;
+                double snappedX = nearbyint(x), snappedY = nearbyint(y);
+                if (fabs(snappedX) > maxDatabaseCoordinate || fabs(snappedY) > maxDatabaseCoordinate) {
+                    printf("error: layer %d has coordinates beyond %d database units, run without --db-units (aborting)\n",
+                           layerNumber, maxDatabaseCoordinate);
+                    exit(1);
+                }
+                if (fabs(x - snappedX) > 1e-6 || fabs(y - snappedY) > 1e-6) {
+                    offGrid++;
+                }
+                elementList.vertices.push_back({static_cast<int32_t>(snappedX), static_cast<int32_t>(snappedY)});
+            }
+            elementList.closeElement();
+        }
+    }
+    if (offGrid) {
+        cerr << "Snapped " << offGrid << " vertices lying between database grid points" << endl;
+    }
+    return layerMapDB;
+}
+
 // Checks if the polygon points are in clockwise order
-bool checkClockwise(Polygon2D polygon) {
-    double area = 0;
-    for (int i = 0; i < polygon.size(); i++) {
-        Vertex2D v1 = polygon[i];
-        Vertex2D v2 = polygon[(i + 1) % polygon.size()];
-        area += (v2.x - v1.x) * (v2.y + v1.y);
+template <typename VertexT>
+bool checkClockwise(const VertexT* polygon, size_t numVertices) {
+    typedef typename VertexTraits<VertexT>::Area Area;
+    Area area = 0;
+    for (size_t i = 0; i < numVertices; i++) {
+        VertexT v1 = polygon[i];
+        VertexT v2 = polygon[(i + 1) % numVertices];
+        area += (Area(v2.x) - v1.x) * (Area(v2.y) + v1.y);
     }
     return area > 0;
 }
 
-// Performs constrained Delaunay triangulation of polygons
-void triangulatePolygons(map<int, ElementList2D>& layerMap) {
-    for (auto& layerPair : layerMap) {
-        ElementList2D& elements = layerPair.second;
-        for (Element2D& element : elements) {
-            Polygon2D& polygon2D = element.polygon2D;
-            TriangleList& triangles = element.triangles;
+// Returns this thread's triangulation for the given insertion order, reset
+// for new input. Reusing it keeps the vertex, triangle and locator buffers
+// of earlier polygons, so steady-state triangulation barely allocates.
+static CDT::Triangulation<double>& reusedTriangulation(CDT::VertexInsertionOrder::Enum insertionOrder) {
+    thread_local CDT::Triangulation<double> asProvided(CDT::VertexInsertionOrder::AsProvided);
+    thread_local CDT::Triangulation<double> automatic(CDT::VertexInsertionOrder::Auto);
+    CDT::Triangulation<double>& cdt = insertionOrder == CDT::VertexInsertionOrder::AsProvided ? asProvided : automatic;
+    cdt.reset();
+    return cdt;
+}
 
-            if (checkClockwise(polygon2D)) {
-                element.clockwise = true;
-            }
+// Triangulates rings given as [begin, end) ranges of one vertex array,
+// filling them by the given rule, and appends triangles indexing that array. Vertices
+// repeated within or across rings (keyhole slits, abutting polygons) are
+// triangulated once and mapped back to their first occurrence. Throws
+// CDT::IntersectingConstraintsError if ring edges cross.
+template <typename VertexT>
+void triangulateRingsCDT(const VertexT* vertices, const vector<pair<size_t, size_t>>& rings, vector<array<size_t, 3>>& triangles,
+                         CDT::VertexInsertionOrder::Enum insertionOrder, RingFill fill) {
+    // Positions in the concatenated rings, sorted by vertex
+    vector<size_t> ringVertex;
+    for (const auto& ring : rings) {
+        for (size_t i = ring.first; i < ring.second; i++) {
+            ringVertex.push_back(i);
+        }
+    }
+    vector<size_t> order(ringVertex.size());
+    for (size_t k = 0; k < order.size(); k++) {
+        order[k] = k;
+    }
+    sort(order.begin(), order.end(), [vertices, &ringVertex](size_t a, size_t b) {
+        const VertexT& va = vertices[ringVertex[a]];
+        const VertexT& vb = vertices[ringVertex[b]];
+        if (va.x != vb.x) return va.x < vb.x;
+        if (va.y != vb.y) return va.y < vb.y;
+        return ringVertex[a] < ringVertex[b];
+    });
 
-            vector<CustomPoint2D> points;
-            for (const auto& vertex : polygon2D) {
-                points.push_back({vertex.x, vertex.y});
+    vector<CDT::V2d<double>> distinct;
+    vector<size_t> firstOccurrence;
+    vector<CDT::VertInd> distinctIndex(order.size());
+    for (size_t k = 0; k < order.size(); k++) {
+        const VertexT& v = vertices[ringVertex[order[k]]];
+        if (k == 0 || v.x != vertices[ringVertex[order[k - 1]]].x || v.y != vertices[ringVertex[order[k - 1]]].y) {
+            distinct.push_back(CDT::V2d<double>::make(v.x, v.y));
+            firstOccurrence.push_back(ringVertex[order[k]]);
+        }
+        distinctIndex[order[k]] = static_cast<CDT::VertInd>(distinct.size() - 1);
+    }
+
+    // Edges walked twice (a keyhole slit, an edge shared by two rings) are
+    // counted as overlaps by the CDT, so the even-odd fill stays right
+    vector<CDT::Edge> edges;
+    size_t ringStart = 0;
+    for (const auto& ring : rings) {
+        size_t numVertices = ring.second - ring.first;
+        for (size_t i = 0; i < numVertices; i++) {
+            CDT::VertInd start = distinctIndex[ringStart + i], end = distinctIndex[ringStart + (i + 1) % numVertices];
+            if (start != end) {
+                edges.push_back(CDT::Edge(start, end));
             }
+        }
+        ringStart += numVertices;
+    }
 
-            vector<pair<int, int>> boundarySegments(points.size());
-            for (int j = 0; j < points.size(); j++) {
-                boundarySegments[j] = {j, (j + 1) % points.size()};
+    CDT::Triangulation<double>& cdt = reusedTriangulation(insertionOrder);
+    cdt.insertVertices(distinct);
+    cdt.insertEdges(edges);
+    if (fill == RingFill::EvenOdd) {
+        cdt.eraseOuterTrianglesAndHoles();
+        for (const auto& tri : cdt.triangles) {
+            triangles.push_back({firstOccurrence[tri.vertices[0]], firstOccurrence[tri.vertices[1]], firstOccurrence[tri.vertices[2]]});
+        }
+        return;
+    }
+
+    // Coverage only changes across ring edges, so it is tested once, at a
+    // triangle centroid, for every patch of triangles the edges enclose.
+    // Neighbor k of a triangle lies across its edge (k, k + 1).
+    cdt.eraseSuperTriangle();
+    vector<BoundingBox> ringBounds;
+    for (const auto& ring : rings) {
+        ringBounds.push_back(polygonBounds(vertices + ring.first, ring.second - ring.first));
+    }
+    auto covered = [&](double x, double y) {
+        for (size_t r = 0; r < rings.size(); r++) {
+            const BoundingBox& box = ringBounds[r];
+            if (box.xMin <= x && x <= box.xMax && box.yMin <= y && y <= box.yMax &&
+                containsPoint(vertices + rings[r].first, rings[r].second - rings[r].first, x, y)) {
+                return true;
             }
+        }
+        return false;
+    };
+    vector<signed char> keep(cdt.triangles.size(), -1);
+    vector<CDT::TriInd> patch;
+    for (CDT::TriInd seed = 0; seed < cdt.triangles.size(); seed++) {
+        if (keep[seed] != -1) {
+            continue;
+        }
+        const CDT::VerticesArr3& corners = cdt.triangles[seed].vertices;
+        double x = (distinct[corners[0]].x + distinct[corners[1]].x + distinct[corners[2]].x) / 3;
+        double y = (distinct[corners[0]].y + distinct[corners[1]].y + distinct[corners[2]].y) / 3;
+        keep[seed] = covered(x, y);
+        patch.assign(1, seed);
+        while (!patch.empty()) {
+            const CDT::Triangle& tri = cdt.triangles[patch.back()];
+            patch.pop_back();
+            for (int k = 0; k < 3; k++) {
+                CDT::TriInd neighbor = tri.neighbors[k];
+                if (neighbor == CDT::noNeighbor || keep[neighbor] != -1 ||
+                    cdt.fixedEdges.count(CDT::Edge(tri.vertices[k], tri.vertices[(k + 1) % 3]))) {
+                    continue;
+                }
+                keep[neighbor] = keep[seed];
+                patch.push_back(neighbor);
+            }
+        }
+    }
+    for (CDT::TriInd t = 0; t < cdt.triangles.size(); t++) {
+        if (keep[t]) {
+            const CDT::Triangle& tri = cdt.triangles[t];
+            triangles.push_back({firstOccurrence[tri.vertices[0]], firstOccurrence[tri.vertices[1]], firstOccurrence[tri.vertices[2]]});
+        }
+    }
+}
+
+// Keyhole polygons (a hole joined to the outline by a zero-width slit) visit
+// the slit end points twice, which the CDT rejects when they are inserted as
+// they are
+template <typename VertexT>
+static void triangulateRepeatedVerticesCDT(const VertexT* polygon, size_t numVertices, TriangleList& triangles) {
+    vector<array<size_t, 3>> ringTriangles;
+    triangulateRingsCDT(polygon, {{0, numVertices}}, ringTriangles, CDT::VertexInsertionOrder::AsProvided);
+    for (const auto& tri : ringTriangles) {
+        triangles.push_back({static_cast<int>(tri[0]), static_cast<int>(tri[1]), static_cast<int>(tri[2])});
+    }
+}
+
+// Performs constrained Delaunay triangulation of a single polygon, appending
+// triangles with indices local to the polygon
+template <typename VertexT>
+void triangulateElementCDT(const VertexT* polygon, size_t numVertices, TriangleList& triangles) {
+    // Vertices are read in place and the boundary edge (i, i + 1) is derived
+    // from the vertex it starts at, so nothing is copied before the CDT
+    CDT::Triangulation<double>& cdt = reusedTriangulation(CDT::VertexInsertionOrder::AsProvided);
+    try {
+        cdt.insertVertices(polygon, polygon + numVertices,
+            [](const VertexT& v) { return static_cast<double>(v.x); },
+            [](const VertexT& v) { return static_cast<double>(v.y); }
+        );
+    } catch (const CDT::DuplicateVertexError&) {
+        triangulateRepeatedVerticesCDT(polygon, numVertices, triangles);
+        return;
+    }
+    cdt.insertEdges(polygon, polygon + numVertices,
+        [polygon](const VertexT& v) { return static_cast<CDT::VertInd>(&v - polygon); },
+        [polygon, numVertices](const VertexT& v) { return static_cast<CDT::VertInd>((&v - polygon + 1) % numVertices); }
+    );
+    cdt.eraseOuterTrianglesAndHoles();
+
+    for (const auto& tri : cdt.triangles) {
+        triangles.push_back({static_cast<int>(tri.vertices[0]), static_cast<int>(tri.vertices[1]), static_cast<int>(tri.vertices[2])});
+    }
+}
+
+TriangulationStats& TriangulationStats::operator+=(const TriangulationStats& other) {
+    rectangle += other.rectangle;
+    convex += other.convex;
+    rectilinear += other.rectilinear;
+    cdt += other.cdt;
+    region += other.region;
+    cacheHits += other.cacheHits;
+    cacheMisses += other.cacheMisses;
+    return *this;
+}
+
+// Triangulates a single polygon through the cheapest path its shape allows:
+// closed form for rectangles, a fan for convex polygons, ear clipping for
+// rectilinear ones and the CDT for everything else. Shapes that need ear
+// clipping or the CDT are first looked up in the cache, if there is one.
+template <typename VertexT>
+void triangulateElement(const VertexT* polygon, size_t numVertices, TriangleList& triangles, const TriangulationOptions& options, TriangulationStats& stats) {
+    PolygonClass polygonClass = options.fastPaths ? classifyPolygon(polygon, numVertices) : PolygonClass::General;
+    if (polygonClass == PolygonClass::Rectangle) {
+        triangulateConvex(polygon, numVertices, triangles);
+        stats.rectangle++;
+        return;
+    }
+    if (polygonClass == PolygonClass::Convex) {
+        triangulateConvex(polygon, numVertices, triangles);
+        stats.convex++;
+        return;
+    }
+
+    ShapeKey key;
+    size_t start = 0;
+    if (options.cache) {
+        start = TriangulationCache::canonicalStart(polygon, numVertices);
+        key = options.cache->makeKey(polygon, numVertices, start);
+        if (options.cache->lookup(key, start, triangles)) {
+            stats.cacheHits++;
+            return;
+        }
+        stats.cacheMisses++;
+    }
+
+    size_t numTriangles = triangles.size();
+    if (polygonClass == PolygonClass::Rectilinear && triangulateByEarClipping(polygon, numVertices, triangles)) {
+        stats.rectilinear++;
+    } else {
+        triangulateElementCDT(polygon, numVertices, triangles);
+        stats.cdt++;
+    }
+
+    if (options.cache) {
+        options.cache->store(std::move(key), start, triangles.data() + numTriangles, triangles.data() + triangles.size());
+    }
+}
+
+// Number of consecutive elements of a layer triangulated by one task
+static const size_t elementsPerChunk = 256;
+
+// Triangles and orientations produced for a run of consecutive elements
+template <typename VertexT>
+struct TriangulationChunk {
+    const FlatElementList<VertexT>* elementList;
+    size_t begin, end;
+    TriangleList triangles;
+    vector<size_t> triangleCounts;
+    vector<bool> clockwise;
+    TriangulationStats stats;
+};
+
+template <typename VertexT>
+static void triangulateChunk(TriangulationChunk<VertexT>& chunk, const TriangulationOptions& options) {
+    const FlatElementList<VertexT>& elementList = *chunk.elementList;
+    for (size_t i = chunk.begin; i < chunk.end; i++) {
+        size_t numTriangles = chunk.triangles.size();
+        triangulateElement(elementList.elementVertices(i), elementList.vertexCount(i), chunk.triangles, options, chunk.stats);
+        chunk.triangleCounts.push_back(chunk.triangles.size() - numTriangles);
+        chunk.clockwise.push_back(checkClockwise(elementList.elementVertices(i), elementList.vertexCount(i)));
+    }
+}
 
-            vector<CustomEdge> edges;
-            for (const auto& edge : boundarySegments) {
-                edges.push_back({edge});
+// Triangulates the polygons of several element lists and reports which path each one took
+template <typename VertexT>
+TriangulationStats triangulateElementLists(const vector<FlatElementList<VertexT>*>& elementLists, const TriangulationOptions& options) {
+    if (options.regions) {
+        return triangulateRegions(elementLists, options);
+    }
+
+    // Chunks of all lists share one index range so that work stealing
+    // balances a huge layer against many small ones
+    vector<TriangulationChunk<VertexT>> chunks;
+    for (const FlatElementList<VertexT>* elementList : elementLists) {
+        for (size_t begin = 0; begin < elementList->size(); begin += elementsPerChunk) {
+            chunks.push_back({elementList, begin, min(begin + elementsPerChunk, elementList->size())});
+        }
+    }
+
+    if (options.numThreads == 1) {
+        for (TriangulationChunk<VertexT>& chunk : chunks) {
+            triangulateChunk(chunk, options);
+        }
+    } else {
+        int maxThreads = options.numThreads > 0 ? options.numThreads : tbb::info::default_concurrency();
+        tbb::global_control threadLimit(tbb::global_control::max_allowed_parallelism, maxThreads);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, chunks.size(), 1),
+            [&chunks, &options](const tbb::blocked_range<size_t>& range) {
+                for (size_t i = range.begin(); i != range.end(); i++) {
+                    triangulateChunk(chunks[i], options);
+                }
             }
+        );
+    }
 
-            CDT::Triangulation<double> cdt(CDT::VertexInsertionOrder::AsProvided);
-            cdt.insertVertices(points.begin(), points.end(),
-                [](const CustomPoint2D& p) { return p.data[0]; },
-                [](const CustomPoint2D& p) { return p.data[1]; }
-            );
-            cdt.insertEdges(edges.begin(), edges.end(),
-                [](const CustomEdge& e) { return e.vertices.first; },
-                [](const CustomEdge& e) { return e.vertices.second; }
-            );
-            cdt.eraseOuterTrianglesAndHoles();
-
-            for (const auto& tri : cdt.triangles) {
-                triangles.push_back({static_cast<int>(tri.vertices[0]), static_cast<int>(tri.vertices[1]), static_cast<int>(tri.vertices[2])});
+    // Chunks are stitched back in element order, so the result does not depend on scheduling
+    TriangulationStats stats;
+    auto chunk = chunks.begin();
+    for (FlatElementList<VertexT>* elementList : elementLists) {
+        elementList->triangles.clear();
+        elementList->triangleOffsets.assign(1, 0);
+        for (; chunk != chunks.end() && chunk->elementList == elementList; ++chunk) {
+            elementList->triangles.insert(elementList->triangles.end(), chunk->triangles.begin(), chunk->triangles.end());
+            for (size_t i = 0; i < chunk->triangleCounts.size(); i++) {
+                elementList->triangleOffsets.push_back(elementList->triangleOffsets.back() + chunk->triangleCounts[i]);
+                elementList->clockwise[chunk->begin + i] = chunk->clockwise[i];
             }
+            stats += chunk->stats;
+            TriangleList().swap(chunk->triangles);
         }
     }
+    return stats;
 }
 
-// Converts 2D vertices to 3D by adding a Z coordinate
-Polygon3D insertZ(const Polygon2D& polygon2D, double z) {
-    Polygon3D result;
-    for (const auto& point : polygon2D) {
-        result.push_back({point.x, point.y, z});
+// Triangulates the polygons of every layer and reports which path each one took
+template <typename VertexT>
+TriangulationStats triangulatePolygons(map<int, FlatElementList<VertexT>>& layerMap, const TriangulationOptions& options) {
+    vector<FlatElementList<VertexT>*> elementLists;
+    for (auto& layerPair : layerMap) {
+        elementLists.push_back(&layerPair.second);
     }
-    return result;
+    return triangulateElementLists(elementLists, options);
 }
 
-// Extrudes 2D polygons to 3D by adding top and bottom layers
-map<int, ElementList3D> extrudePolygons(map<int, ElementList2D>& layerMap, double zMin, double zMax) {
-    map<int, ElementList3D> extrudedLayerMap;
+// Extrudes 2D polygons to 3D prisms. The element lists are moved out of
+// layerMap rather than copied, so layerMap is left empty.
+template <typename VertexT>
+map<int, BasicPrismList<VertexT>> extrudePolygons(map<int, FlatElementList<VertexT>>& layerMap, double zMin, double zMax) {
+    map<int, BasicPrismList<VertexT>> extrudedLayerMap;
     for (auto& it : layerMap) {
-        int layerNumber = it.first;
-        ElementList2D& elementList2D = it.second;
-        ElementList3D elementList3D;
-        for (auto& element2D : elementList2D) {
-            Polygon2D& polygon2D = element2D.polygon2D;
-            TriangleList& triangles = element2D.triangles;
-            
-            Polygon3D polygon3DMin = insertZ(polygon2D, zMin);
-            Polygon3D polygon3DMax = insertZ(polygon2D, zMax);
-
-            elementList3D.push_back({polygon3DMin, triangles, false});
-            elementList3D.push_back({polygon3DMax, triangles, false});
-        }
-        extrudedLayerMap[layerNumber] = elementList3D;
+        BasicPrismList<VertexT>& prisms = extrudedLayerMap[it.first];
+        prisms.base = move(it.second);
+        prisms.zMin = zMin;
+        prisms.zMax = zMax;
     }
+    layerMap.clear();
     return extrudedLayerMap;
 }
 
-// Writes the extruded polygons on a specific layer to a PLY file
-void writePLY(const string& filename, const map<int, ElementList3D>& extrudedLayerMap, int layerNumber) {
-    ofstream plyFile(filename);
-    if (!plyFile.is_open()) {
-        cerr << "Failed to open the file: " << filename << endl;
-        return;
+// Checks the byte order of the host, binary PLY records are written in native order
+bool isLittleEndian() {
+    const unsigned int probe = 1;
+    unsigned char firstByte;
+    memcpy(&firstByte, &probe, 1);
+    return firstByte == 1;
+}
+
+// Buffers PLY vertex and face records and writes them out in large blocks
+class PLYRecordWriter {
+public:
+    PLYRecordWriter(ofstream& plyFile, PLYFormat format) : plyFile(plyFile), format(format) {
+        buffer.reserve(bufferSize);
+    }
+    ~PLYRecordWriter() {
+        flush();
+    }
+
+    void vertex(double x, double y, double z) {
+        if (format == PLYFormat::Ascii) {
+            plyFile << x << " " << y << " " << z << "\n";
+            return;
+        }
+        // Vertices are narrowed to the float properties declared in the header
+        float record[3] = {static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)};
+        append(record, sizeof(record));
+    }
+
+    void face(int v0, int v1, int v2) {
+        if (format == PLYFormat::Ascii) {
+            plyFile << "3 " << v0 << " " << v1 << " " << v2 << "\n";
+            return;
+        }
+        // Each face is a uchar count followed by three int indices, so records are packed by hand
+        char record[sizeof(unsigned char) + 3 * sizeof(int)];
+        int indices[3] = {v0, v1, v2};
+        record[0] = 3;
+        memcpy(record + 1, indices, sizeof(indices));
+        append(record, sizeof(record));
+    }
+
+    void flush() {
+        plyFile.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+private:
+    static const size_t bufferSize = 1 << 20;
+
+    void append(const void* record, size_t size) {
+        if (buffer.size() + size > bufferSize) {
+            flush();
+        }
+        buffer.insert(buffer.end(), static_cast<const char*>(record), static_cast<const char*>(record) + size);
     }
 
-    Polygon3D vertices;
-    TriangleList faces;
+    ofstream& plyFile;
+    PLYFormat format;
+    vector<char> buffer;
+};
 
-    const ElementList3D& elementListAtLayerNumber = extrudedLayerMap.at(layerNumber);
-    for (const auto& element : elementListAtLayerNumber) {
-        int baseIndex = vertices.size();
+// Index within a prism list of the cap copy of vertex `local` of element i,
+// for region triangles that reach into the rings after the element
+template <typename VertexT>
+static int capVertexIndex(const FlatElementList<VertexT>& base, size_t i, int local, int cap) {
+    size_t vertex = base.vertexOffsets[i] + local;
+    size_t ring = upper_bound(base.vertexOffsets.begin(), base.vertexOffsets.end(), vertex) - base.vertexOffsets.begin() - 1;
+    return static_cast<int>(2 * base.vertexOffsets[ring] + cap * base.vertexCount(ring) + (vertex - base.vertexOffsets[ring]));
+}
 
-        for (const auto& vertex : element.polygon3D) {
-            vertices.push_back(vertex);
+// Writes the bottom and top ring of every prism of one placed prism list
+template <typename VertexT>
+static void writePrismVertices(PLYRecordWriter& writer, const BasicPrismList<VertexT>& prisms, const Transform2D& transform) {
+    const FlatElementList<VertexT>& base = prisms.base;
+    for (size_t i = 0; i < base.size(); i++) {
+        const VertexT* ring = base.elementVertices(i);
+        size_t numVertices = base.vertexCount(i);
+        for (double z : {prisms.zMin, prisms.zMax}) {
+            for (size_t j = 0; j < numVertices; j++) {
+                Vertex2D placed = transform.apply(ring[j].x * base.unit, ring[j].y * base.unit);
+                writer.vertex(placed.x, placed.y, z);
+            }
         }
+    }
+}
 
-        for (const auto& triplet : element.triangles) {
-            faces.push_back({triplet.x + baseIndex, triplet.y + baseIndex, triplet.z + baseIndex});
+// Writes the cap faces of one placed prism list whose vertices start at
+// baseIndex. Each prism has its bottom ring followed by its top ring, and
+// both caps reuse the ring's triangles. Mirroring placements flip the caps
+// to keep their winding.
+template <typename VertexT>
+static void writePrismCaps(PLYRecordWriter& writer, const BasicPrismList<VertexT>& prisms, int baseIndex, bool flipCaps) {
+    const FlatElementList<VertexT>& base = prisms.base;
+    for (size_t i = 0; i < base.size(); i++) {
+        int numVertices = base.vertexCount(i);
+        const Triangle* triangles = base.elementTriangles(i);
+        for (int cap = 0; cap < 2; cap++) {
+            int capBase = baseIndex + 2 * base.vertexOffsets[i] + cap * numVertices;
+            for (size_t j = 0; j < base.triangleCount(i); j++) {
+                Triangle triplet = triangles[j];
+                if (triplet.x < numVertices && triplet.y < numVertices && triplet.z < numVertices) {
+                    triplet = {triplet.x + capBase, triplet.y + capBase, triplet.z + capBase};
+                } else {
+                    triplet = {capVertexIndex(base, i, triplet.x, cap) + baseIndex, capVertexIndex(base, i, triplet.y, cap) + baseIndex,
+                               capVertexIndex(base, i, triplet.z, cap) + baseIndex};
+                }
+                if (flipCaps) {
+                    writer.face(triplet.x, triplet.z, triplet.y);
+                } else {
+                    writer.face(triplet.x, triplet.y, triplet.z);
+                }
+            }
         }
     }
+}
 
-    int baseIndex1 = 0;
-    int baseIndex2 = 0;
-    for (int i = 0; i < elementListAtLayerNumber.size(); i += 2) {
-        const Element3D& element1 = elementListAtLayerNumber[i];
-        int numVertices = element1.polygon3D.size();
-        baseIndex2 = baseIndex1 + numVertices;
+// Writes the two side wall faces of every ring edge of one placed prism list
+// whose vertices start at baseIndex. Mirroring placements flip them like the caps.
+template <typename VertexT>
+static void writePrismWalls(PLYRecordWriter& writer, const BasicPrismList<VertexT>& prisms, int baseIndex, bool flipWalls) {
+    const FlatElementList<VertexT>& base = prisms.base;
+    for (size_t i = 0; i < base.size(); i++) {
+        int numVertices = base.vertexCount(i);
+        int baseIndex1 = baseIndex + 2 * base.vertexOffsets[i];
+        int baseIndex2 = baseIndex1 + numVertices;
         for (int j = 0; j < numVertices; j++) {
             int next = (j + 1) % numVertices;
             int bottom0 = baseIndex1 + j;
@@ -168,30 +617,210 @@ void writePLY(const string& filename, const map<int, ElementList3D>& extrudedLay
             int top0 = baseIndex2 + j;
             int top1 = baseIndex2 + next;
 
-            faces.push_back({bottom0, bottom1, top1});
-            faces.push_back({top1, top0, bottom0});
+            if (flipWalls) {
+                writer.face(bottom0, top1, bottom1);
+                writer.face(top1, bottom0, top0);
+            } else {
+                writer.face(bottom0, bottom1, top1);
+                writer.face(top1, top0, bottom0);
+            }
         }
-        baseIndex1 += 2 * numVertices;
     }
+}
+
+static void writePLYHeader(ofstream& plyFile, PLYFormat format, size_t numVertices, size_t numFaces) {
+    plyFile << "ply\n";
+    if (format == PLYFormat::Ascii) {
+        plyFile << "format ascii 1.0\n";
+    } else if (isLittleEndian()) {
+        plyFile << "format binary_little_endian 1.0\n";
+    } else {
+        plyFile << "format binary_big_endian 1.0\n";
+    }
+    plyFile << "element vertex " << numVertices << "\n";
+    plyFile << "property float x\n";
+    plyFile << "property float y\n";
+    plyFile << "property float z\n";
+    plyFile << "element face " << numFaces << "\n";
+    plyFile << "property list uchar int vertex_indices\n";
+    plyFile << "end_header\n";
+}
+
+// Writes every placement of extruded geometry reported by forEachInstance to
+// one PLY file. The instances are enumerated three times (counting, vertices,
+// faces) and expanded on the fly, so nothing proportional to the number of
+// placements is held in memory. Coordinates are scaled to user units as they
+// are written. Returns the number of bytes written.
+template <typename VertexT, typename ForEachInstance>
+static size_t writePrismInstances(const string& filename, const ForEachInstance& forEachInstance, PLYFormat format) {
+    ofstream plyFile(filename, ios::binary);
+    if (!plyFile.is_open()) {
+        cerr << "Failed to open the file: " << filename << endl;
+        return 0;
+    }
+
+    size_t numVertices = 0;
+    size_t numFaces = 0;
+    forEachInstance([&](const BasicPrismList<VertexT>& prisms, const Transform2D&) {
+        numVertices += prisms.vertexCount();
+        numFaces += prisms.faceCount();
+    });
+    // Faces index vertices with the int of the header's vertex_indices
+    if (numVertices > INT_MAX) {
+        printf("error: %zu vertices in %s exceed the PLY int indices (aborting)\n", numVertices, filename.c_str());
+        exit(1);
+    }
+    writePLYHeader(plyFile, format, numVertices, numFaces);
 
-    plyFile << "ply" << endl;
-    plyFile << "format ascii 1.0" << endl;
-    plyFile << "element vertex " << vertices.size() << endl;
-    plyFile << "property float x" << endl;
-    plyFile << "property float y" << endl;
-    plyFile << "property float z" << endl;
-    plyFile << "element face " << faces.size() << endl;
-    plyFile << "property list uchar int vertex_indices" << endl;
-    plyFile << "end_header" << endl;
+    PLYRecordWriter writer(plyFile, format);
+    forEachInstance([&](const BasicPrismList<VertexT>& prisms, const Transform2D& transform) {
+        writePrismVertices(writer, prisms, transform);
+    });
 
-    for (const auto& vertex : vertices) {
-        plyFile << vertex.x << " " << vertex.y << " " << vertex.z << endl;
+    int baseIndex = 0;
+    forEachInstance([&](const BasicPrismList<VertexT>& prisms, const Transform2D& transform) {
+        writePrismCaps(writer, prisms, baseIndex, transform.isMirrored());
+        writePrismWalls(writer, prisms, baseIndex, transform.isMirrored());
+        baseIndex += prisms.vertexCount();
+    });
+    writer.flush();
+
+    size_t bytesWritten = plyFile.tellp();
+    plyFile.close();
+    return bytesWritten;
+}
+
+// The record files sit next to the output so they land on the same disk
+PLYStreamWriter::PLYStreamWriter(const string& filename, PLYFormat format)
+    : filename(filename), format(format),
+      vertexFile(filename + ".vertices", ios::binary), capFile(filename + ".caps", ios::binary),
+      wallFile(filename + ".walls", ios::binary) {
+    if (!vertexFile.is_open() || !capFile.is_open() || !wallFile.is_open()) {
+        printf("error: could not create the record files of %s (aborting)\n", filename.c_str());
+        exit(1);
     }
+}
+
+PLYStreamWriter::~PLYStreamWriter() {
+    remove((filename + ".vertices").c_str());
+    remove((filename + ".caps").c_str());
+    remove((filename + ".walls").c_str());
+}
 
-    for (const auto& face : faces) {
-        plyFile << "3 " << face.x << " " << face.y << " " << face.z << endl;
+void PLYStreamWriter::write(const PrismList& prisms) {
+    if (numVertices + prisms.vertexCount() > INT_MAX) {
+        printf("error: more than %d vertices in %s exceed the PLY int indices (aborting)\n", INT_MAX, filename.c_str());
+        exit(1);
+    }
+    {
+        PLYRecordWriter vertexWriter(vertexFile, format);
+        writePrismVertices(vertexWriter, prisms, Transform2D());
     }
+    {
+        PLYRecordWriter capWriter(capFile, format);
+        writePrismCaps(capWriter, prisms, static_cast<int>(numVertices), false);
+    }
+    {
+        PLYRecordWriter wallWriter(wallFile, format);
+        writePrismWalls(wallWriter, prisms, static_cast<int>(numVertices), false);
+    }
+    numVertices += prisms.vertexCount();
+    numFaces += prisms.faceCount();
+}
 
+size_t PLYStreamWriter::finish() {
+    ofstream plyFile(filename, ios::binary);
+    if (!plyFile.is_open()) {
+        cerr << "Failed to open the file: " << filename << endl;
+        return 0;
+    }
+    writePLYHeader(plyFile, format, numVertices, numFaces);
+    for (ofstream* records : {&vertexFile, &capFile, &wallFile}) {
+        records->close();
+    }
+    for (const char* suffix : {".vertices", ".caps", ".walls"}) {
+        ifstream records(filename + suffix, ios::binary);
+        if (records.peek() != ifstream::traits_type::eof()) {
+            plyFile << records.rdbuf();
+        }
+    }
+    size_t bytesWritten = plyFile.tellp();
     plyFile.close();
+    return bytesWritten;
+}
+
+size_t writePLYInstances(const string& filename, const PLYInstanceEnumerator& forEachInstance, PLYFormat format) {
+    return writePrismInstances<Vertex2D>(filename, forEachInstance, format);
+}
+
+// Writes the extruded polygons on a specific layer to a PLY file
+size_t writePLY(const string& filename, const map<int, PrismList>& extrudedLayerMap, int layerNumber, PLYFormat format) {
+    const PrismList& prismsAtLayerNumber = extrudedLayerMap.at(layerNumber);
+    return writePLYInstances(filename, [&](const PLYInstanceVisitor& visit) {
+        visit(prismsAtLayerNumber, Transform2D());
+    }, format);
+}
+
+size_t writePLY(const string& filename, const map<int, PrismListDB>& extrudedLayerMap, int layerNumber, PLYFormat format) {
+    const PrismListDB& prismsAtLayerNumber = extrudedLayerMap.at(layerNumber);
+    return writePrismInstances<VertexDB>(filename, [&](const auto& visit) {
+        visit(prismsAtLayerNumber, Transform2D());
+    }, format);
+}
+
+// Writes one file per layer with at most maxStreams files (and their write
+// buffers) open at once, 0 meaning one per core. Layers are taken largest
+// first from a shared queue, so the biggest file starts immediately and the
+// small ones fill in around it. Returns the bytes written per layer.
+map<int, size_t> writeLayersConcurrently(const map<int, size_t>& layerSizes, const LayerWriter& writeLayer, int maxStreams) {
+    vector<pair<size_t, int>> queue;
+    for (const auto& layer : layerSizes) {
+        queue.push_back({layer.second, layer.first});
+    }
+    stable_sort(queue.begin(), queue.end(), [](const pair<size_t, int>& a, const pair<size_t, int>& b) { return a.first > b.first; });
+
+    vector<size_t> bytesWritten(queue.size(), 0);
+    // TBB has no more workers than cores, larger arenas would only warn
+    int numStreams = maxStreams > 0 ? min(maxStreams, tbb::info::default_concurrency()) : tbb::info::default_concurrency();
+    numStreams = static_cast<int>(min<size_t>(numStreams, queue.size()));
+    if (numStreams <= 1) {
+        for (size_t i = 0; i < queue.size(); i++) {
+            bytesWritten[i] = writeLayer(queue[i].second);
+        }
+    } else {
+        atomic<size_t> next(0);
+        tbb::task_arena arena(numStreams);
+        arena.execute([&] {
+            tbb::task_group streams;
+            for (int stream = 0; stream < numStreams; stream++) {
+                streams.run([&] {
+                    for (size_t i = next++; i < queue.size(); i = next++) {
+                        bytesWritten[i] = writeLayer(queue[i].second);
+                    }
+                });
+            }
+            streams.wait();
+        });
+    }
+
+    map<int, size_t> layerBytes;
+    for (size_t i = 0; i < queue.size(); i++) {
+        layerBytes[queue[i].second] = bytesWritten[i];
+    }
+    return layerBytes;
 }
 
+template bool checkClockwise(const Vertex2D*, size_t);
+template bool checkClockwise(const VertexDB*, size_t);
+template void triangulateRingsCDT(const Vertex2D*, const vector<pair<size_t, size_t>>&, vector<array<size_t, 3>>&, CDT::VertexInsertionOrder::Enum, RingFill);
+template void triangulateRingsCDT(const VertexDB*, const vector<pair<size_t, size_t>>&, vector<array<size_t, 3>>&, CDT::VertexInsertionOrder::Enum, RingFill);
+template void triangulateElementCDT(const Vertex2D*, size_t, TriangleList&);
+template void triangulateElementCDT(const VertexDB*, size_t, TriangleList&);
+template void triangulateElement(const Vertex2D*, size_t, TriangleList&, const TriangulationOptions&, TriangulationStats&);
+template void triangulateElement(const VertexDB*, size_t, TriangleList&, const TriangulationOptions&, TriangulationStats&);
+template TriangulationStats triangulateElementLists(const vector<ElementList2D*>&, const TriangulationOptions&);
+template TriangulationStats triangulateElementLists(const vector<ElementListDB*>&, const TriangulationOptions&);
+template TriangulationStats triangulatePolygons(map<int, ElementList2D>&, const TriangulationOptions&);
+template TriangulationStats triangulatePolygons(map<int, ElementListDB>&, const TriangulationOptions&);
+template map<int, PrismList> extrudePolygons(map<int, ElementList2D>&, double, double);
+template map<int, PrismListDB> extrudePolygons(map<int, ElementListDB>&, double, double);
@@ -0,0 +1,491 @@
+// GDSStreamReader.cpp
+
+#include "include/GDSStreamReader.h"
+#include "include/ProcessStack.h"
+
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+#include <tbb/global_control.h>
+#include <tbb/info.h>
+#include <tbb/task_group.h>
+
+// GDSII record types used by the reader
+enum GDSRecordType {
+    UNITS = 0x03,
+    ENDLIB = 0x04,
+    BGNSTR = 0x05,
+    STRNAME = 0x06,
+    ENDSTR = 0x07,
+    BOUNDARY_RECORD = 0x08,
+    PATH_RECORD = 0x09,
+    SREF_RECORD = 0x0A,
+    AREF_RECORD = 0x0B,
+    TEXT_RECORD = 0x0C,
+    LAYER = 0x0D,
+    DATATYPE = 0x0E,
+    XY = 0x10,
+    ENDEL = 0x11,
+    SNAME = 0x12,
+    COLROW = 0x13,
+    NODE_RECORD = 0x15,
+    STRANS = 0x1A,
+    MAG = 0x1B,
+    ANGLE = 0x1C,
+    BOX_RECORD = 0x2D
+};
+
+// Deepest SREF/AREF nesting accepted before the file is considered cyclic
+static const int maxReferenceDepth = 256;
+
+// Number of polygons of a layer handed to one triangulation task
+static const size_t polygonsPerBatch = 4096;
+
+static void abortRead(const string& fileName, const string& message) {
+    printf("error: %s: %s (aborting)\n", fileName.c_str(), message.c_str());
+    exit(1);
+}
+
+static int16_t readInt16(const unsigned char* p) {
+    return static_cast<int16_t>((p[0] << 8) | p[1]);
+}
+
+static int32_t readInt32(const unsigned char* p) {
+    return static_cast<int32_t>((uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]));
+}
+
+// GDSII 8-byte real: sign bit, excess-64 base-16 exponent, 56-bit mantissa
+static double readReal64(const unsigned char* p) {
+    uint64_t mantissa = 0;
+    for (int i = 1; i < 8; i++) {
+        mantissa = (mantissa << 8) | p[i];
+    }
+    double value = ldexp(static_cast<double>(mantissa), 4 * ((p[0] & 0x7f) - 64) - 56);
+    return (p[0] & 0x80) ? -value : value;
+}
+
+static string readString(const unsigned char* p, size_t length) {
+    string value(reinterpret_cast<const char*>(p), length);
+    while (!value.empty() && value.back() == '\0') {
+        value.pop_back();
+    }
+    return value;
+}
+
+GDSStreamReader::GDSStreamReader(const char* gdsFileName) : fileName(gdsFileName) {
+    int fd = open(gdsFileName, O_RDONLY);
+    if (fd < 0) {
+        abortRead(fileName, "could not open file");
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        close(fd);
+        abortRead(fileName, "could not stat file or file is empty");
+    }
+    size = fileStat.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        abortRead(fileName, "could not map file");
+    }
+    // Indexing and the walk of each structure read front to back. Unlike
+    // WILLNEED this does not fault in the whole file up front, and pages
+    // already read can be dropped, so files larger than memory still map.
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    data = static_cast<const unsigned char*>(mapping);
+    indexStructures();
+}
+
+GDSStreamReader::~GDSStreamReader() {
+    if (data) {
+        munmap(const_cast<unsigned char*>(data), size);
+    }
+}
+
+// Records the byte range of every structure and which structures are
+// referenced, to find the top cells. No geometry is decoded here.
+void GDSStreamReader::indexStructures() {
+    vector<pair<string, StructRange>> ordered;
+    unordered_set<string> referenced;
+    string name;
+    size_t begin = 0;
+    for (size_t offset = 0; offset + 4 <= size;) {
+        size_t length = (data[offset] << 8) | data[offset + 1];
+        int recordType = data[offset + 2];
+        const unsigned char* payload = data + offset + 4;
+        if (length < 4 || offset + length > size) {
+            abortRead(fileName, "corrupt record at byte " + to_string(offset));
+        }
+        if (recordType == UNITS && length >= 12) {
+            unit = readReal64(payload);
+        } else if (recordType == STRNAME) {
+            name = readString(payload, length - 4);
+            begin = offset + length;
+        } else if (recordType == ENDSTR) {
+            ordered.push_back({name, {begin, offset}});
+        } else if (recordType == SNAME) {
+            referenced.insert(readString(payload, length - 4));
+        } else if (recordType == ENDLIB) {
+            break;
+        }
+        offset += length;
+    }
+
+    for (const auto& structure : ordered) {
+        structures[structure.first] = structure.second;
+        if (referenced.count(structure.first) == 0) {
+            topStructures.push_back(structure.second);
+        }
+    }
+}
+
+// One element of a structure, as read from its records up to ENDEL
+struct StreamElement {
+    int type = -1;
+    int layer = 0, datatype = 0;
+    const unsigned char* xy = nullptr;
+    size_t numPoints = 0;
+    string sname;
+    bool reflected = false;
+    double magnification = 1.0, angle = 0.0;
+    int columns = 1, rows = 1;
+};
+
+// State shared by every structure of one walk
+struct GDSStreamReader::Walk {
+    const PolygonCallback& callback;
+    const BoundingBox* window;                       // in database units, or null
+    vector<Vertex2D> polygon;                        // reused vertex buffer
+    unordered_map<size_t, BoundingBox> cellBounds;   // by structure begin, filled on demand
+};
+
+// Placement of copy (column, row) of an SREF/AREF in database units
+static Transform2D elementPlacement(const StreamElement& element, int column, int row) {
+    double originX = readInt32(element.xy), originY = readInt32(element.xy + 4);
+    double dx = originX, dy = originY;
+    if (element.type == AREF_RECORD) {
+        double columnStepX = (readInt32(element.xy + 8) - originX) / element.columns;
+        double columnStepY = (readInt32(element.xy + 12) - originY) / element.columns;
+        double rowStepX = (readInt32(element.xy + 16) - originX) / element.rows;
+        double rowStepY = (readInt32(element.xy + 20) - originY) / element.rows;
+        dx += column * columnStepX + row * rowStepX;
+        dy += column * columnStepY + row * rowStepY;
+    }
+    return placementTransform(element.angle, element.magnification, element.reflected, dx, dy);
+}
+
+// Box of the four corners of a box under a transform. A box that meets
+// nothing stays that way.
+static BoundingBox transformBounds(const BoundingBox& box, const Transform2D& transform) {
+    if (box.xMin > box.xMax) {
+        return box;
+    }
+    BoundingBox placed{INFINITY, INFINITY, -INFINITY, -INFINITY};
+    for (double x : {box.xMin, box.xMax}) {
+        for (double y : {box.yMin, box.yMax}) {
+            Vertex2D corner = transform.apply(x, y);
+            placed.xMin = min(placed.xMin, corner.x);
+            placed.yMin = min(placed.yMin, corner.y);
+            placed.xMax = max(placed.xMax, corner.x);
+            placed.yMax = max(placed.yMax, corner.y);
+        }
+    }
+    return placed;
+}
+
+void GDSStreamReader::forEachPolygon(const PolygonCallback& callback, const BoundingBox* window) const {
+    // The window is widened by a database unit so rounding cannot drop a cell
+    // whose polygons only touch it
+    BoundingBox windowDB;
+    if (window) {
+        windowDB = {window->xMin / unit - 1, window->yMin / unit - 1, window->xMax / unit + 1, window->yMax / unit + 1};
+    }
+    Walk walk{callback, window ? &windowDB : nullptr, {}, {}};
+    for (const StructRange& range : topStructures) {
+        if (walk.window && !walk.window->intersects(structureBounds(range, 0, walk))) {
+            continue;
+        }
+        walkStructure(range, Transform2D(), 0, walk);
+    }
+}
+
+// Reads the records of one structure in place and calls visit at the end of
+// every element
+template <typename Visitor>
+void GDSStreamReader::forEachElement(const StructRange& range, const Visitor& visit) const {
+    StreamElement element;
+    for (size_t offset = range.begin; offset < range.end;) {
+        size_t length = (data[offset] << 8) | data[offset + 1];
+        int recordType = data[offset + 2];
+        const unsigned char* payload = data + offset + 4;
+        if (length < 4 || offset + length > range.end) {
+            abortRead(fileName, "corrupt record at byte " + to_string(offset));
+        }
+        offset += length;
+
+        switch (recordType) {
+        case BOUNDARY_RECORD:
+        case BOX_RECORD:
+        case PATH_RECORD:
+        case SREF_RECORD:
+        case AREF_RECORD:
+        case TEXT_RECORD:
+        case NODE_RECORD:
+            element = StreamElement();
+            element.type = recordType;
+            break;
+        case LAYER:
+            element.layer = readInt16(payload);
+            break;
+        case DATATYPE:
+            element.datatype = readInt16(payload);
+            break;
+        case XY:
+            element.xy = payload;
+            element.numPoints = (length - 4) / 8;
+            break;
+        case SNAME:
+            element.sname = readString(payload, length - 4);
+            break;
+        case STRANS:
+            element.reflected = (payload[0] & 0x80) != 0;
+            break;
+        case MAG:
+            element.magnification = readReal64(payload);
+            break;
+        case ANGLE:
+            element.angle = readReal64(payload);
+            break;
+        case COLROW:
+            element.columns = readInt16(payload);
+            element.rows = readInt16(payload + 2);
+            break;
+        case ENDEL:
+            if (element.numPoints > 0) {
+                // A reference is a single copy unless it is a well-formed array
+                if (element.type != AREF_RECORD || element.numPoints < 3 || element.columns <= 0 || element.rows <= 0) {
+                    element.columns = element.rows = 1;
+                    if (element.type == AREF_RECORD) {
+                        element.type = SREF_RECORD;
+                    }
+                }
+                visit(element);
+            }
+            element.type = -1;
+            break;
+        }
+    }
+}
+
+// Box of everything a structure places, in its own frame and database units.
+// Each structure is measured once per walk, so placements whose copy misses
+// the window are skipped without decoding the cell below them.
+BoundingBox GDSStreamReader::structureBounds(const StructRange& range, int depth, Walk& walk) const {
+    auto cached = walk.cellBounds.find(range.begin);
+    if (cached != walk.cellBounds.end()) {
+        return cached->second;
+    }
+    if (depth > maxReferenceDepth) {
+        abortRead(fileName, "reference nesting too deep, the hierarchy is probably cyclic");
+    }
+
+    BoundingBox bounds{INFINITY, INFINITY, -INFINITY, -INFINITY};
+    auto include = [&bounds](const BoundingBox& box) {
+        bounds.xMin = min(bounds.xMin, box.xMin);
+        bounds.yMin = min(bounds.yMin, box.yMin);
+        bounds.xMax = max(bounds.xMax, box.xMax);
+        bounds.yMax = max(bounds.yMax, box.yMax);
+    };
+    forEachElement(range, [&](const StreamElement& element) {
+        if (element.type == BOUNDARY_RECORD || element.type == BOX_RECORD) {
+            for (size_t k = 0; k < element.numPoints; k++) {
+                double x = readInt32(element.xy + 8 * k), y = readInt32(element.xy + 8 * k + 4);
+                include({x, y, x, y});
+            }
+        } else if (element.type == SREF_RECORD || element.type == AREF_RECORD) {
+            auto it = structures.find(element.sname);
+            if (it == structures.end()) {
+                return;
+            }
+            // The copies of an array form a lattice, so its corner copies bound it
+            BoundingBox child = structureBounds(it->second, depth + 1, walk);
+            for (int column : {0, element.columns - 1}) {
+                for (int row : {0, element.rows - 1}) {
+                    include(transformBounds(child, elementPlacement(element, column, row)));
+                }
+            }
+        }
+    });
+    walk.cellBounds[range.begin] = bounds;
+    return bounds;
+}
+
+// Decodes the elements of one structure in place. Transforms work in database
+// units and the user unit is applied to each emitted vertex, like libGDSII.
+void GDSStreamReader::walkStructure(const StructRange& range, const Transform2D& transform, int depth, Walk& walk) const {
+    if (depth > maxReferenceDepth) {
+        abortRead(fileName, "reference nesting too deep, the hierarchy is probably cyclic");
+    }
+
+    forEachElement(range, [&](const StreamElement& element) {
+        if (element.type == BOUNDARY_RECORD || element.type == BOX_RECORD) {
+            // The closing point repeats the first one
+            const unsigned char* xy = element.xy;
+            size_t numPoints = element.numPoints, numVertices = numPoints;
+            if (numVertices > 1 && readInt32(xy) == readInt32(xy + 8 * (numPoints - 1)) &&
+                readInt32(xy + 4) == readInt32(xy + 8 * (numPoints - 1) + 4)) {
+                numVertices--;
+            }
+            walk.polygon.resize(numVertices);
+            for (size_t k = 0; k < numVertices; k++) {
+                Vertex2D placed = transform.apply(readInt32(xy + 8 * k), readInt32(xy + 8 * k + 4));
+                walk.polygon[k] = {placed.x * unit, placed.y * unit};
+            }
+            walk.callback(element.layer, element.datatype, walk.polygon.data(), numVertices);
+        } else if (element.type == SREF_RECORD || element.type == AREF_RECORD) {
+            auto it = structures.find(element.sname);
+            if (it == structures.end()) {
+                cerr << "Skipping reference to undefined cell " << element.sname << endl;
+                return;
+            }
+            for (int column = 0; column < element.columns; column++) {
+                for (int row = 0; row < element.rows; row++) {
+                    Transform2D placed = transform * elementPlacement(element, column, row);
+                    if (walk.window && !walk.window->intersects(transformBounds(structureBounds(it->second, depth + 1, walk), placed))) {
+                        continue;
+                    }
+                    walkStructure(it->second, placed, depth + 1, walk);
+                }
+            }
+        }
+    });
+}
+
+// Polygons of one layer waiting for, or done with, triangulation
+struct PolygonBatch {
+    int layer;
+    ElementList2D elementList;
+    TriangulationStats stats;
+    atomic<bool> done{false};
+};
+
+// Streams flattened polygons out of the reader into per-layer batches and
+// triangulates every full batch in a background task while parsing goes on.
+// Each triangulated batch is handed to consume and freed; the batches of one
+// layer arrive in file order, so appending them matches the serial path.
+// At most a few batches per thread are in flight, parsing waits for them
+// beyond that, so memory stays bounded by the batch size whatever the file size.
+// With a window, placements whose cells miss it are not walked and the other
+// polygons outside it are dropped before they are copied. With a process
+// stack batches are keyed by stack layer and polygons of GDS
+// layers/datatypes outside the stack are dropped the same way.
+TriangulationStats streamTriangulatedBatches(const GDSStreamReader& reader, const TriangulationOptions& options,
+                                             const function<void(int, ElementList2D&)>& consume, const BoundingBox* window,
+                                             bool clip, const ProcessStack* stack) {
+    int maxThreads = options.numThreads > 0 ? options.numThreads : tbb::info::default_concurrency();
+    tbb::global_control threadLimit(tbb::global_control::max_allowed_parallelism, maxThreads);
+    TriangulationOptions batchOptions = options;
+    batchOptions.numThreads = 1;
+    size_t maxPending = 4 * static_cast<size_t>(maxThreads);
+
+    // Per layer, the submitted batches in file order followed by the one being filled
+    map<int, deque<unique_ptr<PolygonBatch>>> layerBatches;
+    map<int, PolygonBatch*> openBatches;
+    size_t numPending = 0;
+    TriangulationStats stats;
+    tbb::task_group triangulation;
+    auto consumeDone = [&] {
+        for (auto& layer : layerBatches) {
+            deque<unique_ptr<PolygonBatch>>& batches = layer.second;
+            while (!batches.empty() && batches.front()->done) {
+                consume(layer.first, batches.front()->elementList);
+                stats += batches.front()->stats;
+                batches.pop_front();
+                numPending--;
+            }
+        }
+    };
+    auto submit = [&](PolygonBatch* batch) {
+        numPending++;
+        if (options.numThreads == 1) {
+            batch->stats = triangulateElementLists<Vertex2D>({&batch->elementList}, batchOptions);
+            batch->done = true;
+        } else {
+            triangulation.run([batch, &batchOptions] {
+                batch->stats = triangulateElementLists<Vertex2D>({&batch->elementList}, batchOptions);
+                batch->done = true;
+            });
+        }
+        if (numPending > maxPending) {
+            triangulation.wait();
+        }
+        consumeDone();
+    };
+
+    vector<Vertex2D> clipped;
+    vector<int> keys;
+    reader.forEachPolygon([&](int layer, int datatype, const Vertex2D* polygon, size_t numVertices) {
+        keys.clear();
+        if (stack) {
+            stack->findAll(layer, datatype, keys);
+        } else {
+            keys.push_back(layer);
+        }
+        if (keys.empty()) {
+            return;
+        }
+        if (window) {
+            BoundingBox bounds = polygonBounds(polygon, numVertices);
+            if (!window->intersects(bounds)) {
+                return;
+            }
+            if (clip && !window->contains(bounds)) {
+                clipPolygon(polygon, numVertices, *window, clipped);
+                if (clipped.empty()) {
+                    return;
+                }
+                polygon = clipped.data();
+                numVertices = clipped.size();
+            }
+        }
+        for (int key : keys) {
+            PolygonBatch*& batch = openBatches[key];
+            if (batch == nullptr) {
+                layerBatches[key].push_back(unique_ptr<PolygonBatch>(new PolygonBatch{key}));
+                batch = layerBatches[key].back().get();
+            }
+            batch->elementList.vertices.insert(batch->elementList.vertices.end(), polygon, polygon + numVertices);
+            batch->elementList.closeElement();
+            if (batch->elementList.size() == polygonsPerBatch) {
+                PolygonBatch* full = batch;
+                batch = nullptr;
+                submit(full);
+            }
+        }
+    }, window);
+    for (auto& openBatch : openBatches) {
+        if (openBatch.second) {
+            submit(openBatch.second);
+        }
+    }
+    triangulation.wait();
+    consumeDone();
+    return stats;
+}
+
+// Collects the streamed batches into one element list per layer, for the
+// stages that need whole layers
+map<int, ElementList2D> streamTriangulatedPolygons(const GDSStreamReader& reader, const TriangulationOptions& options, TriangulationStats& stats,
+                                                   const BoundingBox* window, bool clip, const ProcessStack* stack) {
+    map<int, ElementList2D> layerMap;
+    stats += streamTriangulatedBatches(reader, options, [&](int layer, ElementList2D& batch) {
+        layerMap[layer].append(batch);
+    }, window, clip, stack);
+    return layerMap;
+}
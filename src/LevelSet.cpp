@@ -0,0 +1,241 @@
+// LevelSet.cpp
+//
+// Rasterizes extruded polygons straight into narrow-band level sets. The
+// signed distance of a prism is built from the 2D distance to its polygons
+// and the distance to its z slab, so no mesh is generated and nothing goes
+// through a file.
+
+#include "include/LevelSet.h"
+#include "include/CSG.h"
+#include "include/SpatialIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <openvdb/tools/Prune.h>
+#include <openvdb/tools/SignedFloodFill.h>
+#include <openvdb/tree/LeafManager.h>
+
+typedef openvdb::FloatTree::LeafNodeType FloatLeaf;
+
+static const int leafDim = FloatLeaf::DIM;
+
+// Origin of the leaf node holding index coordinate i
+static int leafOrigin(int i) {
+    return i & ~(leafDim - 1);
+}
+
+static double segmentDistance(double x, double y, const Vertex2D& a, const Vertex2D& b) {
+    double dx = b.x - a.x, dy = b.y - a.y;
+    double lengthSquared = dx * dx + dy * dy;
+    double t = lengthSquared > 0 ? ((x - a.x) * dx + (y - a.y) * dy) / lengthSquared : 0.0;
+    t = min(max(t, 0.0), 1.0);
+    double ex = a.x + t * dx - x, ey = a.y + t * dy - y;
+    return sqrt(ex * ex + ey * ey);
+}
+
+static double boundaryDistance(const Vertex2D* ring, size_t numVertices, double x, double y) {
+    double distance = INFINITY;
+    for (size_t i = 0; i < numVertices; i++) {
+        distance = min(distance, segmentDistance(x, y, ring[i], ring[(i + 1) % numVertices]));
+    }
+    return distance;
+}
+
+static bool insideUnion(const ElementList2D& base, const vector<size_t>& rings, double x, double y) {
+    for (size_t i : rings) {
+        if (containsPoint(base.elementVertices(i), base.vertexCount(i), x, y)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Pieces of the ring edges that lie on the boundary of the union of all
+// polygons, grouped by ring. Every edge is cut where the edges of nearby
+// rings cross or overlap it, and a piece is kept when the union covers
+// exactly one of its sides. Keyhole slits, edges shared by abutting polygons
+// and edges inside overlapping polygons have the union on both sides and
+// are dropped.
+struct UnionBoundary {
+    vector<pair<Vertex2D, Vertex2D>> segments;
+    vector<size_t> offsets = {0}; // ring i owns [offsets[i], offsets[i + 1])
+
+    UnionBoundary(const ElementList2D& base, const LayerGrid& index) {
+        vector<double> cuts;
+        for (size_t r = 0; r < base.size(); r++) {
+            const Vertex2D* ring = base.elementVertices(r);
+            size_t numVertices = base.vertexCount(r);
+            vector<size_t> neighbours = index.query(index.elementBounds(r));
+            for (size_t e = 0; e < numVertices; e++) {
+                const Vertex2D& a = ring[e];
+                const Vertex2D& b = ring[(e + 1) % numVertices];
+                double ex = b.x - a.x, ey = b.y - a.y;
+                double length = sqrt(ex * ex + ey * ey);
+                if (length == 0) {
+                    continue;
+                }
+                cuts.assign({0.0, 1.0});
+                for (size_t other : neighbours) {
+                    addEdgeCuts(a, b, base.elementVertices(other), base.vertexCount(other), other == r ? e : SIZE_MAX, cuts);
+                }
+                sort(cuts.begin(), cuts.end());
+                cuts.erase(unique(cuts.begin(), cuts.end()), cuts.end());
+
+                for (size_t k = 0; k + 1 < cuts.size(); k++) {
+                    double t0 = cuts[k], t1 = cuts[k + 1];
+                    double mx = a.x + 0.5 * (t0 + t1) * ex, my = a.y + 0.5 * (t0 + t1) * ey;
+                    // Sample a small fraction of the piece's length off either side
+                    double offset = 1e-6 * (t1 - t0);
+                    bool left = insideUnion(base, neighbours, mx - offset * ey, my + offset * ex);
+                    bool right = insideUnion(base, neighbours, mx + offset * ey, my - offset * ex);
+                    if (left != right) {
+                        segments.push_back({{a.x + t0 * ex, a.y + t0 * ey}, {a.x + t1 * ex, a.y + t1 * ey}});
+                    }
+                }
+            }
+            offsets.push_back(segments.size());
+        }
+    }
+};
+
+// Signed distance of the union of the candidate polygons at (x, y), negative
+// inside, measured to the pieces of their edges on the union's boundary
+static double signedDistance2D(const ElementList2D& base, const UnionBoundary& boundary, const vector<size_t>& candidates, double x, double y) {
+    double distance = INFINITY;
+    for (size_t i : candidates) {
+        for (size_t s = boundary.offsets[i]; s < boundary.offsets[i + 1]; s++) {
+            distance = min(distance, segmentDistance(x, y, boundary.segments[s].first, boundary.segments[s].second));
+        }
+    }
+    return insideUnion(base, candidates, x, y) ? -distance : distance;
+}
+
+// Exact distance to the extrusion of a 2D region over [zMin, zMax] from the
+// 2D signed distance and the signed distance to the slab
+static double prismDistance(double distance2D, double distanceZ) {
+    if (distance2D <= 0 && distanceZ <= 0) {
+        return max(distance2D, distanceZ);
+    }
+    double outsideXY = max(distance2D, 0.0), outsideZ = max(distanceZ, 0.0);
+    return sqrt(outsideXY * outsideXY + outsideZ * outsideZ);
+}
+
+// Leaf nodes that can hold narrow-band voxels: every z along columns that
+// meet a polygon's boundary (side walls), and only the cap z ranges along
+// columns fully inside a polygon
+static vector<openvdb::Coord> bandLeafOrigins(const PrismList& prisms, double voxelSize, double band) {
+    const ElementList2D& base = prisms.base;
+    auto toIndex = [voxelSize](double v) { return static_cast<int>(floor(v / voxelSize + 0.5)); };
+    int wallZ0 = leafOrigin(toIndex(prisms.zMin - band)), wallZ1 = leafOrigin(toIndex(prisms.zMax + band));
+    int bottomZ1 = leafOrigin(toIndex(prisms.zMin + band)), topZ0 = leafOrigin(toIndex(prisms.zMax - band));
+    double leafSide = leafDim * voxelSize;
+    double leafReach = 0.5 * sqrt(2.0) * leafSide + band;
+
+    vector<openvdb::Coord> origins;
+    for (size_t p = 0; p < base.size(); p++) {
+        const Vertex2D* ring = base.elementVertices(p);
+        size_t numVertices = base.vertexCount(p);
+        BoundingBox bounds = polygonBounds(ring, numVertices);
+        int i0 = leafOrigin(toIndex(bounds.xMin - band)), i1 = leafOrigin(toIndex(bounds.xMax + band));
+        int j0 = leafOrigin(toIndex(bounds.yMin - band)), j1 = leafOrigin(toIndex(bounds.yMax + band));
+        for (int i = i0; i <= i1; i += leafDim) {
+            for (int j = j0; j <= j1; j += leafDim) {
+                // Centre of the leaf column; voxel centres sit on integer index coordinates
+                double cx = (i + 0.5 * (leafDim - 1)) * voxelSize, cy = (j + 0.5 * (leafDim - 1)) * voxelSize;
+                if (boundaryDistance(ring, numVertices, cx, cy) <= leafReach) {
+                    for (int k = wallZ0; k <= wallZ1; k += leafDim) {
+                        origins.push_back(openvdb::Coord(i, j, k));
+                    }
+                } else if (containsPoint(ring, numVertices, cx, cy)) {
+                    for (int k = wallZ0; k <= bottomZ1; k += leafDim) {
+                        origins.push_back(openvdb::Coord(i, j, k));
+                    }
+                    for (int k = max(topZ0, bottomZ1 + leafDim); k <= wallZ1; k += leafDim) {
+                        origins.push_back(openvdb::Coord(i, j, k));
+                    }
+                }
+            }
+        }
+    }
+    sort(origins.begin(), origins.end());
+    origins.erase(unique(origins.begin(), origins.end()), origins.end());
+    return origins;
+}
+
+// Builds the narrow-band signed distance field of one extruded layer. Leaf
+// nodes near the surface are allocated up front and filled in parallel, one
+// leaf per task; inactive space then gets its sign from a flood fill.
+openvdb::FloatGrid::Ptr prismsToLevelSet(const PrismList& prisms, const LevelSetOptions& options) {
+    const double voxelSize = options.voxelSize;
+    const double band = options.halfWidth * voxelSize;
+    const float background = static_cast<float>(band);
+
+    openvdb::FloatGrid::Ptr grid = openvdb::FloatGrid::create(background);
+    grid->setTransform(openvdb::math::Transform::createLinearTransform(voxelSize));
+    grid->setGridClass(openvdb::GRID_LEVEL_SET);
+    if (prisms.base.size() == 0) {
+        return grid;
+    }
+
+    openvdb::FloatTree& tree = grid->tree();
+    for (const openvdb::Coord& origin : bandLeafOrigins(prisms, voxelSize, band)) {
+        tree.touchLeaf(origin);
+    }
+
+    LayerGrid index(prisms.base);
+    UnionBoundary boundary(prisms.base, index);
+    openvdb::tree::LeafManager<openvdb::FloatTree> leafManager(tree);
+    leafManager.foreach([&](FloatLeaf& leaf, size_t) {
+        const openvdb::Coord origin = leaf.origin();
+        BoundingBox leafBounds{(origin.x() * voxelSize) - band, (origin.y() * voxelSize) - band,
+                               ((origin.x() + leafDim - 1) * voxelSize) + band, ((origin.y() + leafDim - 1) * voxelSize) + band};
+        vector<size_t> candidates = index.query(leafBounds);
+
+        // The 2D distance is shared by the leafDim voxels of each column
+        for (int i = 0; i < leafDim; i++) {
+            for (int j = 0; j < leafDim; j++) {
+                double x = (origin.x() + i) * voxelSize, y = (origin.y() + j) * voxelSize;
+                double distance2D = signedDistance2D(prisms.base, boundary, candidates, x, y);
+                for (int k = 0; k < leafDim; k++) {
+                    double z = (origin.z() + k) * voxelSize;
+                    double distance = prismDistance(distance2D, max(prisms.zMin - z, z - prisms.zMax));
+                    openvdb::Index offset = FloatLeaf::coordToOffset(origin.offsetBy(i, j, k));
+                    if (fabs(distance) < band) {
+                        leaf.setValueOn(offset, static_cast<float>(distance));
+                    } else {
+                        leaf.setValueOff(offset, distance < 0 ? -background : background);
+                    }
+                }
+            }
+        }
+    });
+
+    openvdb::tools::signedFloodFill(tree);
+    openvdb::tools::pruneLevelSet(tree);
+    return grid;
+}
+
+// One level set per extruded layer, named by gridName
+openvdb::GridPtrVec layersToLevelSets(const map<int, PrismList>& layerMap3D, const function<string(int)>& gridName, const LevelSetOptions& options) {
+    openvdb::GridPtrVec grids;
+    for (const auto& layer : layerMap3D) {
+        openvdb::FloatGrid::Ptr grid = prismsToLevelSet(layer.second, options);
+        grid->setName(gridName(layer.first));
+        grids.push_back(grid);
+    }
+    return grids;
+}
+
+// Union of all layers as one level set. Each layer is rasterized when the
+// reduction tree reaches it and merged right away, which keeps the peak at a
+// few layer grids rather than all of them.
+openvdb::FloatGrid::Ptr layersToMask(const map<int, PrismList>& layerMap3D, const LevelSetOptions& options) {
+    vector<const PrismList*> layers;
+    for (const auto& layer : layerMap3D) {
+        layers.push_back(&layer.second);
+    }
+    return csgReduce(CSGOperation::Union, layers.size(), [&](size_t i) {
+        return prismsToLevelSet(*layers[i], options);
+    });
+}
@@ -0,0 +1,90 @@
+// PipelineStats.cpp
+
+#include "include/PipelineStats.h"
+
+#include <iomanip>
+#include <sys/resource.h>
+
+// Largest resident set of the process so far, in KiB (Linux reports ru_maxrss in KiB)
+long peakRSSKiB() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
+
+PipelineStats::PipelineStats() : start(chrono::steady_clock::now()) {}
+
+void PipelineStats::recordStage(const string& name, double seconds) {
+    stages.push_back({name, seconds, peakRSSKiB()});
+}
+
+template <typename VertexT>
+void PipelineStats::countElements(int layerNumber, const FlatElementList<VertexT>& elementList) {
+    LayerCounters& counters = layers[layerNumber];
+    counters.polygons += elementList.size();
+    counters.vertices += elementList.vertices.size();
+    counters.triangles += elementList.triangles.size();
+}
+
+template void PipelineStats::countElements(int, const ElementList2D&);
+template void PipelineStats::countElements(int, const ElementListDB&);
+
+void PipelineStats::printTable(ostream& out) const {
+    double total = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    ios_base::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    out << fixed << setprecision(1);
+
+    out << left << setw(24) << "Stage" << right << setw(12) << "Time (ms)" << setw(16) << "Peak RSS (MiB)" << "\n";
+    for (const StageRecord& stage : stages) {
+        out << left << setw(24) << stage.name << right << setw(12) << stage.seconds * 1e3
+            << setw(16) << stage.peakRSSKiB / 1024.0 << "\n";
+    }
+    out << left << setw(24) << "total" << right << setw(12) << total * 1e3 << setw(16) << peakRSSKiB() / 1024.0 << "\n";
+
+    LayerCounters sum;
+    out << "\n" << left << setw(10) << "Layer" << right << setw(12) << "Polygons" << setw(14) << "Vertices"
+        << setw(14) << "Triangles" << setw(16) << "Bytes written" << "\n";
+    for (const auto& layer : layers) {
+        const LayerCounters& counters = layer.second;
+        out << left << setw(10) << layer.first << right << setw(12) << counters.polygons << setw(14) << counters.vertices
+            << setw(14) << counters.triangles << setw(16) << counters.bytesWritten << "\n";
+        sum.polygons += counters.polygons;
+        sum.vertices += counters.vertices;
+        sum.triangles += counters.triangles;
+        sum.bytesWritten += counters.bytesWritten;
+    }
+    out << left << setw(10) << "total" << right << setw(12) << sum.polygons << setw(14) << sum.vertices
+        << setw(14) << sum.triangles << setw(16) << sum.bytesWritten << endl;
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+// Stage names are program constants, so they need no JSON escaping
+void PipelineStats::writeJSON(const string& filename) const {
+    ofstream json(filename);
+    if (!json.is_open()) {
+        cerr << "Failed to open the file: " << filename << endl;
+        return;
+    }
+    double total = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    json << setprecision(9);
+    json << "{\n  \"total_seconds\": " << total << ",\n  \"peak_rss_kib\": " << peakRSSKiB() << ",\n  \"stages\": [";
+    for (size_t i = 0; i < stages.size(); i++) {
+        json << (i ? "," : "") << "\n    {\"name\": \"" << stages[i].name << "\", \"seconds\": " << stages[i].seconds
+             << ", \"peak_rss_kib\": " << stages[i].peakRSSKiB << "}";
+    }
+    json << "\n  ],\n  \"layers\": [";
+    bool first = true;
+    for (const auto& layer : layers) {
+        const LayerCounters& counters = layer.second;
+        json << (first ? "" : ",") << "\n    {\"layer\": " << layer.first << ", \"polygons\": " << counters.polygons
+             << ", \"vertices\": " << counters.vertices << ", \"triangles\": " << counters.triangles
+             << ", \"bytes_written\": " << counters.bytesWritten << "}";
+        first = false;
+    }
+    json << "\n  ]\n}\n";
+}
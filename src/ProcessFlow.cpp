@@ -0,0 +1,359 @@
+// ProcessFlow.cpp
+
+#include "include/ProcessFlow.h"
+#include "include/GDSStreamReader.h"
+#include "include/CSG.h"
+
+#include <set>
+#include <sstream>
+#include <openvdb/tools/LevelSetFilter.h>
+#include <openvdb/tools/LevelSetPlatonic.h>
+#include <tbb/global_control.h>
+#include <tbb/info.h>
+#include <tbb/parallel_for.h>
+
+static void abortRecipe(const string& fileName, int lineNumber, const string& message) {
+    printf("error: %s:%d: %s (aborting)\n", fileName.c_str(), lineNumber, message.c_str());
+    exit(1);
+}
+
+static double parseNumber(const string& text, const string& fileName, int lineNumber) {
+    char* end;
+    double value = strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0') {
+        abortRecipe(fileName, lineNumber, "bad number '" + text + "'");
+    }
+    return value;
+}
+
+static openvdb::Vec3d parsePoint(const string& text, const string& fileName, int lineNumber) {
+    double x, y, z;
+    char trailing;
+    if (sscanf(text.c_str(), "%lf,%lf,%lf%c", &x, &y, &z, &trailing) != 3) {
+        abortRecipe(fileName, lineNumber, "bad point '" + text + "', expected X,Y,Z");
+    }
+    return openvdb::Vec3d(x, y, z);
+}
+
+void ProcessFlow::load(const string& recipeFileName) {
+    ifstream recipeFile(recipeFileName);
+    if (!recipeFile.is_open()) {
+        printf("error: could not open recipe %s (aborting)\n", recipeFileName.c_str());
+        exit(1);
+    }
+    recipeName = recipeFileName;
+
+    LevelSetOptions levelSet;
+    set<string> defined;
+    string line;
+    for (int lineNumber = 1; getline(recipeFile, line); lineNumber++) {
+        istringstream fields(line.substr(0, line.find('#')));
+        vector<string> tokens;
+        for (string token; fields >> token;) {
+            tokens.push_back(token);
+        }
+        if (tokens.empty()) {
+            continue;
+        }
+
+        FlowStep step;
+        step.line = lineNumber;
+        step.operation = tokens[0];
+        size_t numArgs = tokens.size() - 1;
+        auto expect = [&](bool valid, const char* usage) {
+            if (!valid) {
+                abortRecipe(recipeName, lineNumber, string("usage: ") + usage);
+            }
+        };
+
+        const string& op = step.operation;
+        if (op == "voxel") {
+            expect(numArgs == 1, "voxel SIZE");
+            levelSet.voxelSize = parseNumber(tokens[1], recipeName, lineNumber);
+            continue;
+        } else if (op == "band") {
+            expect(numArgs == 1, "band HALF_WIDTH");
+            levelSet.halfWidth = static_cast<float>(parseNumber(tokens[1], recipeName, lineNumber));
+            continue;
+        } else if (op == "mask") {
+            expect(numArgs == 5, "mask NAME GDS LAYER[/DATATYPE] Z0 THICKNESS");
+            step.output = tokens[1];
+            step.args.assign(tokens.begin() + 2, tokens.end());
+        } else if (op == "box") {
+            expect(numArgs == 3, "box NAME X0,Y0,Z0 X1,Y1,Z1");
+            step.output = tokens[1];
+            step.args.assign(tokens.begin() + 2, tokens.end());
+            openvdb::Vec3d corner0 = parsePoint(step.args[0], recipeName, lineNumber);
+            openvdb::Vec3d corner1 = parsePoint(step.args[1], recipeName, lineNumber);
+            for (int axis = 0; axis < 3; axis++) {
+                if (!(corner0[axis] < corner1[axis])) {
+                    abortRecipe(recipeName, lineNumber, "box corners must satisfy X0 < X1, Y0 < Y1 and Z0 < Z1");
+                }
+            }
+        } else if (op == "read") {
+            expect(numArgs == 2 || numArgs == 3, "read NAME FILE [GRID]");
+            step.output = tokens[1];
+            step.args.assign(tokens.begin() + 2, tokens.end());
+        } else if (op == "deposit") {
+            expect(numArgs == 3, "deposit NAME BASE THICKNESS");
+            step.output = tokens[1];
+            step.inputs = {tokens[2]};
+            step.args = {tokens[3]};
+        } else if (op == "etch") {
+            expect(numArgs == 2, "etch TARGET TOOL");
+            step.output = tokens[1];
+            step.inputs = {tokens[1], tokens[2]};
+        } else if (op == "planarize") {
+            expect(numArgs == 2, "planarize NAME Z");
+            step.output = tokens[1];
+            step.inputs = {tokens[1]};
+            step.args = {tokens[2]};
+        } else if (op == "union" || op == "intersect") {
+            expect(numArgs >= 2, "union|intersect NAME A [B...]");
+            step.output = tokens[1];
+            step.inputs.assign(tokens.begin() + 2, tokens.end());
+        } else if (op == "csg") {
+            expect(numArgs >= 2, "csg NAME EXPRESSION");
+            step.output = tokens[1];
+            string text;
+            for (size_t i = 2; i < tokens.size(); i++) {
+                text += (i > 2 ? " " : "") + tokens[i];
+            }
+            string error;
+            unique_ptr<CSGExpression> expression = parseCSGExpression(text, error);
+            if (!expression) {
+                abortRecipe(recipeName, lineNumber, "bad expression: " + error);
+            }
+            csgGridNames(*expression, step.inputs);
+            step.args = {text};
+        } else if (op == "subtract") {
+            expect(numArgs == 3, "subtract NAME A B");
+            step.output = tokens[1];
+            step.inputs = {tokens[2], tokens[3]};
+        } else if (op == "copy") {
+            expect(numArgs == 2, "copy NAME A");
+            step.output = tokens[1];
+            step.inputs = {tokens[2]};
+        } else if (op == "write") {
+            expect(numArgs >= 2, "write FILE NAME [NAME...]");
+            step.args = {tokens[1]};
+            step.inputs.assign(tokens.begin() + 2, tokens.end());
+        } else {
+            abortRecipe(recipeName, lineNumber, "unknown step '" + op + "'");
+        }
+
+        // Catch typos before anything runs
+        for (const string& input : step.inputs) {
+            if (defined.count(input) == 0) {
+                abortRecipe(recipeName, lineNumber, "grid '" + input + "' is not defined by an earlier step");
+            }
+        }
+        if (!step.output.empty()) {
+            defined.insert(step.output);
+        }
+        step.levelSet = levelSet;
+        recipe.push_back(step);
+    }
+}
+
+openvdb::FloatGrid::Ptr ProcessFlow::grid(const string& name) const {
+    lock_guard<mutex> lock(gridsMutex);
+    auto it = grids.find(name);
+    return it != grids.end() ? it->second : nullptr;
+}
+
+void ProcessFlow::store(const string& name, openvdb::FloatGrid::Ptr result) {
+    result->setName(name);
+    lock_guard<mutex> lock(gridsMutex);
+    grids[name] = result;
+}
+
+// Extrudes the polygons of one layout layer into a level set, without triangulating them
+static openvdb::FloatGrid::Ptr maskLevelSet(const FlowStep& step, const string& recipeName) {
+    int layer, datatype = -1;
+    char separator, trailing;
+    int numFields = sscanf(step.args[1].c_str(), "%d%c%d%c", &layer, &separator, &datatype, &trailing);
+    if (!(numFields == 1 || (numFields == 3 && separator == '/'))) {
+        abortRecipe(recipeName, step.line, "bad layer '" + step.args[1] + "'");
+    }
+    if (numFields == 1) {
+        datatype = -1;
+    }
+
+    PrismList prisms;
+    prisms.zMin = parseNumber(step.args[2], recipeName, step.line);
+    prisms.zMax = prisms.zMin + parseNumber(step.args[3], recipeName, step.line);
+    GDSStreamReader reader(step.args[0].c_str());
+    reader.forEachPolygon([&](int polygonLayer, int polygonDatatype, const Vertex2D* polygon, size_t numVertices) {
+        if (polygonLayer == layer && (datatype < 0 || polygonDatatype == datatype)) {
+            prisms.base.vertices.insert(prisms.base.vertices.end(), polygon, polygon + numVertices);
+            prisms.base.closeElement();
+        }
+    });
+    return prismsToLevelSet(prisms, step.levelSet);
+}
+
+void ProcessFlow::execute(const FlowStep& step) {
+    const string& op = step.operation;
+    vector<openvdb::FloatGrid::Ptr> inputs;
+    for (const string& name : step.inputs) {
+        inputs.push_back(grid(name));
+    }
+
+    openvdb::FloatGrid::Ptr result;
+    if (op == "mask") {
+        result = maskLevelSet(step, recipeName);
+    } else if (op == "box") {
+        openvdb::BBoxd box(parsePoint(step.args[0], recipeName, step.line), parsePoint(step.args[1], recipeName, step.line));
+        openvdb::math::Transform::Ptr transform = openvdb::math::Transform::createLinearTransform(step.levelSet.voxelSize);
+        result = openvdb::tools::createLevelSetBox<openvdb::FloatGrid>(box, *transform, step.levelSet.halfWidth);
+    } else if (op == "read") {
+        // A missing or damaged file ends the run at its recipe line instead of escaping the parallel loop
+        try {
+            openvdb::io::File file(step.args[0]);
+            file.open();
+            openvdb::GridBase::Ptr baseGrid;
+            if (step.args.size() > 1) {
+                if (!file.hasGrid(step.args[1])) {
+                    abortRecipe(recipeName, step.line, "no grid named " + step.args[1] + " in " + step.args[0]);
+                }
+                baseGrid = file.readGrid(step.args[1]);
+            } else {
+                openvdb::GridPtrVecPtr fileGrids = file.getGrids();
+                if (!fileGrids || fileGrids->empty()) {
+                    abortRecipe(recipeName, step.line, step.args[0] + " holds no grids");
+                }
+                baseGrid = fileGrids->front();
+            }
+            file.close();
+            result = openvdb::gridPtrCast<openvdb::FloatGrid>(baseGrid);
+            if (!result) {
+                abortRecipe(recipeName, step.line, "grid in " + step.args[0] + " is not a float grid");
+            }
+        } catch (const openvdb::Exception& error) {
+            abortRecipe(recipeName, step.line, "could not read " + step.args[0] + ": " + error.what());
+        }
+    } else if (op == "deposit") {
+        // Grow a copy of the base by the film thickness and keep what is new
+        openvdb::FloatGrid::Ptr grown = inputs[0]->deepCopy();
+        openvdb::tools::LevelSetFilter<openvdb::FloatGrid> filter(*grown);
+        filter.offset(static_cast<float>(-parseNumber(step.args[0], recipeName, step.line)));
+        result = csgCombine(CSGOperation::Difference, *grown, *inputs[0]);
+    } else if (op == "etch" || op == "subtract") {
+        result = csgCombine(CSGOperation::Difference, *inputs[0], *inputs[1]);
+    } else if (op == "planarize") {
+        // Keep the part of the grid below Z: intersect with a block reaching past its extent
+        double z = parseNumber(step.args[0], recipeName, step.line);
+        const openvdb::FloatGrid& source = *inputs[0];
+        openvdb::CoordBBox active = source.evalActiveVoxelBoundingBox();
+        // An empty grid has no extent to cut, it stays empty like one cut below its bottom
+        if (!active.empty()) {
+            openvdb::BBoxd extent = source.transform().indexToWorld(active);
+            openvdb::Vec3d margin(step.levelSet.halfWidth * source.voxelSize()[0] * 2);
+            openvdb::BBoxd below(extent.min() - margin, openvdb::Vec3d(extent.max().x() + margin.x(), extent.max().y() + margin.y(), z));
+            if (z > below.min().z()) {
+                openvdb::FloatGrid::Ptr block = openvdb::tools::createLevelSetBox<openvdb::FloatGrid>(below, source.transform(), step.levelSet.halfWidth);
+                result = csgCombine(CSGOperation::Intersection, source, *block);
+            }
+        }
+        if (!result) {
+            result = openvdb::FloatGrid::create(source.background());
+            result->setTransform(source.transform().copy());
+            result->setGridClass(openvdb::GRID_LEVEL_SET);
+        }
+    } else if (op == "union" || op == "intersect") {
+        CSGOperation operation = op == "union" ? CSGOperation::Union : CSGOperation::Intersection;
+        result = csgReduce(operation, vector<openvdb::FloatGrid::ConstPtr>(inputs.begin(), inputs.end()));
+    } else if (op == "csg") {
+        string error;
+        unique_ptr<CSGExpression> expression = parseCSGExpression(step.args[0], error);
+        result = evaluateCSG(*expression, [this](const string& name) { return grid(name); });
+    } else if (op == "copy") {
+        result = inputs[0]->deepCopy();
+    } else if (op == "write") {
+        // Shallow copies share the trees and only carry the recipe names
+        openvdb::GridPtrVec named;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            openvdb::FloatGrid::Ptr copy = inputs[i]->copy();
+            copy->setName(step.inputs[i]);
+            named.push_back(copy);
+        }
+        openvdb::io::File(step.args[0]).write(named);
+        return;
+    }
+    store(step.output, result);
+}
+
+// Runs the recipe level by level. A step's level is one more than that of
+// every earlier step it must follow: the last writer of each grid it reads or
+// writes, and every reader of the grid it overwrites. Steps on the same level
+// touch disjoint grids and run in parallel. Each grid is released after the
+// level of its last reader, so only the grids still needed are held.
+void ProcessFlow::run(int numThreads) {
+    vector<int> level(recipe.size(), 0);
+    map<string, int> lastWriter;
+    map<string, vector<int>> readers;
+    // Last level that uses the current version of each grid, after which it is released
+    map<string, int> lastUse;
+    map<int, vector<string>> releases;
+    int numLevels = 0;
+    for (size_t j = 0; j < recipe.size(); j++) {
+        const FlowStep& step = recipe[j];
+        int stepLevel = 0;
+        for (const string& input : step.inputs) {
+            auto writer = lastWriter.find(input);
+            if (writer != lastWriter.end()) {
+                stepLevel = max(stepLevel, level[writer->second] + 1);
+            }
+        }
+        if (!step.output.empty()) {
+            auto writer = lastWriter.find(step.output);
+            if (writer != lastWriter.end()) {
+                stepLevel = max(stepLevel, level[writer->second] + 1);
+            }
+            for (int reader : readers[step.output]) {
+                stepLevel = max(stepLevel, level[reader] + 1);
+            }
+        }
+        level[j] = stepLevel;
+        numLevels = max(numLevels, stepLevel + 1);
+
+        for (const string& input : step.inputs) {
+            readers[input].push_back(static_cast<int>(j));
+            lastUse[input] = max(lastUse[input], stepLevel);
+        }
+        if (!step.output.empty()) {
+            lastWriter[step.output] = static_cast<int>(j);
+            readers[step.output].clear();
+            // A step that reads the grid it overwrites replaces it in place
+            auto use = lastUse.find(step.output);
+            if (use != lastUse.end() && use->second < stepLevel) {
+                releases[use->second].push_back(step.output);
+            }
+            lastUse[step.output] = stepLevel;
+        }
+    }
+    for (const auto& use : lastUse) {
+        releases[use.second].push_back(use.first);
+    }
+
+    vector<vector<size_t>> levels(numLevels);
+    for (size_t j = 0; j < recipe.size(); j++) {
+        levels[level[j]].push_back(j);
+    }
+
+    int maxThreads = numThreads > 0 ? numThreads : tbb::info::default_concurrency();
+    tbb::global_control threadLimit(tbb::global_control::max_allowed_parallelism, maxThreads);
+    for (size_t l = 0; l < levels.size(); l++) {
+        const vector<size_t>& steps = levels[l];
+        tbb::parallel_for(size_t(0), steps.size(), [&](size_t i) {
+            execute(recipe[steps[i]]);
+        });
+        // Grids no later step reads are dropped; write steps have saved what the recipe keeps
+        for (const string& name : releases[static_cast<int>(l)]) {
+            lock_guard<mutex> lock(gridsMutex);
+            grids.erase(name);
+        }
+        cout << "Level " << l << ": " << steps.size() << " step(s) done" << endl;
+    }
+}
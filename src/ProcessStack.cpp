@@ -0,0 +1,166 @@
+// ProcessStack.cpp
+
+#include "include/ProcessStack.h"
+#include "include/CellHierarchy.h"
+
+#include <sstream>
+
+static void abortStack(const string& filename, int lineNumber, const string& message) {
+    printf("error: %s:%d: %s (aborting)\n", filename.c_str(), lineNumber, message.c_str());
+    exit(1);
+}
+
+// Reads a process stack file. Each line holds
+//     layer[/datatype]  material  z-bottom  thickness
+// in user units; '-' as z-bottom stacks the layer on top of the previous one.
+// Blank lines and text after '#' are ignored.
+ProcessStack readProcessStack(const string& filename) {
+    ifstream stackFile(filename);
+    if (!stackFile.is_open()) {
+        printf("error: could not open process stack %s (aborting)\n", filename.c_str());
+        exit(1);
+    }
+
+    ProcessStack stack;
+    string line;
+    for (int lineNumber = 1; getline(stackFile, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        istringstream fields(line);
+        string layerField, zField;
+        StackLayer stackLayer;
+        if (!(fields >> layerField)) {
+            continue;
+        }
+        if (!(fields >> stackLayer.material >> zField >> stackLayer.thickness)) {
+            abortStack(filename, lineNumber, "expected layer[/datatype] material z-bottom thickness");
+        }
+
+        char separator = 0, trailing;
+        int numFields = sscanf(layerField.c_str(), "%d%c%d%c", &stackLayer.layer, &separator, &stackLayer.datatype, &trailing);
+        if (!(numFields == 1 || (numFields == 3 && separator == '/')) || stackLayer.layer < 0 ||
+            (numFields == 3 && stackLayer.datatype < 0)) {
+            abortStack(filename, lineNumber, "bad layer '" + layerField + "'");
+        }
+        if (numFields == 1) {
+            stackLayer.datatype = -1;
+        }
+
+        if (zField == "-") {
+            stackLayer.zBottom = stack.layers.empty() ? 0.0 : stack.layers.back().zTop();
+        } else {
+            char* end;
+            stackLayer.zBottom = strtod(zField.c_str(), &end);
+            if (*end != '\0') {
+                abortStack(filename, lineNumber, "bad z-bottom '" + zField + "'");
+            }
+        }
+        if (stackLayer.thickness <= 0) {
+            abortStack(filename, lineNumber, "thickness must be positive");
+        }
+        stack.layers.push_back(stackLayer);
+    }
+    if (stack.layers.empty()) {
+        printf("error: process stack %s has no layers (aborting)\n", filename.c_str());
+        exit(1);
+    }
+    return stack;
+}
+
+bool ProcessStack::usesDatatypes() const {
+    for (const StackLayer& stackLayer : layers) {
+        if (stackLayer.datatype >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ProcessStack::findAll(int layer, int datatype, vector<int>& stackIndices) const {
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (layers[i].layer == layer && (layers[i].datatype < 0 || layers[i].datatype == datatype)) {
+            stackIndices.push_back(static_cast<int>(i));
+        }
+    }
+}
+
+// Names are numbered in stack order, e.g. "03_metal1_L21" or "03_metal1_L21D2"
+string ProcessStack::layerName(int stackIndex) const {
+    const StackLayer& stackLayer = layers[stackIndex];
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "%02d_", stackIndex);
+    string name = prefix + stackLayer.material + "_L" + to_string(stackLayer.layer);
+    if (stackLayer.datatype >= 0) {
+        name += "D" + to_string(stackLayer.datatype);
+    }
+    return name;
+}
+
+// Rekeys a layer map by stack layer. Polygons of GDS layers missing from the
+// stack are dropped before they cost any triangulation; a GDS layer used by
+// several stack layers is copied into each of them.
+template <typename VertexT>
+map<int, FlatElementList<VertexT>> assignStackLayers(map<int, FlatElementList<VertexT>>& layerMap, const ProcessStack& stack) {
+    map<int, vector<int>> targets;
+    for (size_t i = 0; i < stack.layers.size(); i++) {
+        targets[stack.layers[i].layer].push_back(static_cast<int>(i));
+    }
+
+    map<int, FlatElementList<VertexT>> stackMap;
+    for (auto& layerPair : layerMap) {
+        auto it = targets.find(layerPair.first);
+        if (it == targets.end()) {
+            continue;
+        }
+        const vector<int>& stackIndices = it->second;
+        for (size_t k = 0; k + 1 < stackIndices.size(); k++) {
+            stackMap[stackIndices[k]] = layerPair.second;
+        }
+        stackMap[stackIndices.back()] = move(layerPair.second);
+    }
+    layerMap.clear();
+    return stackMap;
+}
+
+template map<int, ElementList2D> assignStackLayers(map<int, ElementList2D>&, const ProcessStack&);
+template map<int, ElementListDB> assignStackLayers(map<int, ElementListDB>&, const ProcessStack&);
+
+// Rekeys every cell of a hierarchy by stack layer, including the layers
+// recorded for its subtree
+void assignStackLayers(CellHierarchy& hierarchy, const ProcessStack& stack) {
+    for (Cell& cell : hierarchy.cells) {
+        cell.layers = assignStackLayers(cell.layers, stack);
+        set<int> subtreeLayers;
+        for (size_t i = 0; i < stack.layers.size(); i++) {
+            if (cell.subtreeLayers.count(stack.layers[i].layer)) {
+                subtreeLayers.insert(static_cast<int>(i));
+            }
+        }
+        cell.subtreeLayers.swap(subtreeLayers);
+    }
+}
+
+// Extrudes every stack layer between its own bottom and top in one pass.
+// Like extrudePolygons, the element lists are moved out of stackMap.
+template <typename VertexT>
+map<int, BasicPrismList<VertexT>> extrudeStack(map<int, FlatElementList<VertexT>>& stackMap, const ProcessStack& stack) {
+    map<int, BasicPrismList<VertexT>> extrudedStackMap;
+    for (auto& it : stackMap) {
+        const StackLayer& stackLayer = stack.layers[it.first];
+        BasicPrismList<VertexT>& prisms = extrudedStackMap[it.first];
+        prisms.base = move(it.second);
+        prisms.zMin = stackLayer.zBottom;
+        prisms.zMax = stackLayer.zTop();
+    }
+    stackMap.clear();
+    return extrudedStackMap;
+}
+
+template map<int, PrismList> extrudeStack(map<int, ElementList2D>&, const ProcessStack&);
+template map<int, PrismListDB> extrudeStack(map<int, ElementListDB>&, const ProcessStack&);
+
+// Extrudes the polygons of every cell of a hierarchy assigned to the stack
+void extrudeStack(CellHierarchy& hierarchy, const ProcessStack& stack) {
+    for (Cell& cell : hierarchy.cells) {
+        cell.extrudedLayers = extrudeStack(cell.layers, stack);
+    }
+}
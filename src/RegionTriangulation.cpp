@@ -0,0 +1,282 @@
+// RegionTriangulation.cpp
+//
+// Layer-wide triangulation: rings whose bounding boxes overlap are grouped
+// into regions and each region is triangulated by one CDT that keeps what any
+// of its rings covers. Polygons on a layer union, as in GDSII, so nested,
+// overlapping and abutting rings come out filled and holes come only from
+// keyholes. A ring whose edges cross another ring's would need vertices of
+// its own at the crossings, so it is triangulated alone; the rest of its
+// region stays joint. Small regions are packed together so the CDT setup is
+// shared by many rings.
+
+#include "include/RegionTriangulation.h"
+#include "include/SpatialIndex.h"
+
+#include <cstdint>
+#include <numeric>
+#include "include/lib/predicates.h"
+#include <tbb/blocked_range.h>
+#include <tbb/global_control.h>
+#include <tbb/info.h>
+#include <tbb/parallel_for.h>
+
+// Lone rings handed to one task, as in triangulateElementLists
+static const size_t ringsPerBatch = 256;
+// Vertices of packed regions per CDT; a larger region gets a CDT of its own
+static const size_t verticesPerRegionBatch = 1 << 14;
+
+// Rings of one element list triangulated by one task. A joint batch holds
+// whole regions and goes through one CDT; any other batch holds lone rings,
+// which take the usual per-polygon paths.
+template <typename VertexT>
+struct RegionBatch {
+    FlatElementList<VertexT>* elementList;
+    vector<size_t> rings;
+    vector<size_t> regionEnds; // end of each region in rings, for joint batches
+    bool joint;
+    vector<size_t> owners;     // ring that keeps each triangle
+    TriangleList triangles;
+    TriangulationStats stats;
+};
+
+static size_t findRoot(vector<size_t>& parent, size_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+template <typename VertexT>
+static double orientation(const VertexT& a, const VertexT& b, const VertexT& c) {
+    return predicates::adaptive::orient2d<double>(a.x, a.y, b.x, b.y, c.x, c.y);
+}
+
+// Whether the interiors of segments ab and cd cross at a single point
+template <typename VertexT>
+static bool segmentsCross(const VertexT& a, const VertexT& b, const VertexT& c, const VertexT& d) {
+    double abc = orientation(a, b, c), abd = orientation(a, b, d);
+    double cda = orientation(c, d, a), cdb = orientation(c, d, b);
+    return ((abc > 0 && abd < 0) || (abc < 0 && abd > 0)) && ((cda > 0 && cdb < 0) || (cda < 0 && cdb > 0));
+}
+
+// Whether an edge of ring i crosses an edge of ring j; edges of i outside
+// the box of j are skipped. Touching, T-junctions and shared edges do not
+// count, since the CDT splits them at existing vertices.
+template <typename VertexT>
+static bool ringsCross(const FlatElementList<VertexT>& elementList, size_t i, size_t j, const BoundingBox& boxJ) {
+    const VertexT* ringI = elementList.elementVertices(i);
+    const VertexT* ringJ = elementList.elementVertices(j);
+    size_t countI = elementList.vertexCount(i), countJ = elementList.vertexCount(j);
+    for (size_t k = 0; k < countI; k++) {
+        const VertexT& a = ringI[k];
+        const VertexT& b = ringI[(k + 1) % countI];
+        BoundingBox edge{double(min(a.x, b.x)), double(min(a.y, b.y)), double(max(a.x, b.x)), double(max(a.y, b.y))};
+        if (!edge.intersects(boxJ)) {
+            continue;
+        }
+        for (size_t l = 0; l < countJ; l++) {
+            if (segmentsCross(a, b, ringJ[l], ringJ[(l + 1) % countJ])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Groups the rings of a list by overlapping bounding boxes and packs the
+// groups into batches. Rings that cross another ring go to lone batches, and
+// what is left of a group is joint if it still holds more than one ring.
+template <typename VertexT>
+static void collectBatches(FlatElementList<VertexT>& elementList, vector<RegionBatch<VertexT>>& batches) {
+    size_t numRings = elementList.size();
+    vector<size_t> parent(numRings);
+    iota(parent.begin(), parent.end(), 0);
+    vector<bool> crosses(numRings, false);
+    LayerGrid grid(elementList);
+    for (size_t i = 0; i < numRings; i++) {
+        for (size_t j : grid.query(grid.elementBounds(i))) {
+            if (j > i && (!crosses[i] || !crosses[j]) && ringsCross(elementList, i, j, grid.elementBounds(j))) {
+                crosses[i] = crosses[j] = true;
+            }
+            size_t a = findRoot(parent, i), b = findRoot(parent, j);
+            if (a != b) {
+                parent[max(a, b)] = min(a, b);
+            }
+        }
+    }
+
+    // Regions in the order of their first ring, each with its rings ascending
+    vector<vector<size_t>> regions;
+    vector<size_t> regionOf(numRings);
+    for (size_t i = 0; i < numRings; i++) {
+        size_t root = findRoot(parent, i);
+        if (root == i) {
+            regionOf[i] = regions.size();
+            regions.emplace_back();
+        }
+        regions[regionOf[root]].push_back(i);
+    }
+
+    // Batches are addressed by index since adding one may move the others
+    const size_t none = SIZE_MAX;
+    size_t lone = none, joint = none;
+    size_t jointVertices = 0;
+    auto addLone = [&](size_t ring) {
+        if (lone == none || batches[lone].rings.size() == ringsPerBatch) {
+            lone = batches.size();
+            joint = none;
+            batches.push_back({&elementList, {}, {}, false});
+        }
+        batches[lone].rings.push_back(ring);
+    };
+    for (vector<size_t>& region : regions) {
+        vector<size_t> joined;
+        for (size_t ring : region) {
+            if (crosses[ring]) {
+                addLone(ring);
+            } else {
+                joined.push_back(ring);
+            }
+        }
+        if (joined.size() == 1) {
+            addLone(joined[0]);
+        }
+        if (joined.size() <= 1) {
+            continue;
+        }
+        region.swap(joined);
+        size_t regionVertices = 0;
+        for (size_t ring : region) {
+            regionVertices += elementList.vertexCount(ring);
+        }
+        if (joint == none || jointVertices + regionVertices > verticesPerRegionBatch) {
+            joint = batches.size();
+            lone = none;
+            jointVertices = 0;
+            batches.push_back({&elementList, {}, {}, true});
+        }
+        RegionBatch<VertexT>& batch = batches[joint];
+        batch.rings.insert(batch.rings.end(), region.begin(), region.end());
+        batch.regionEnds.push_back(batch.rings.size());
+        jointVertices += regionVertices;
+    }
+}
+
+// Appends the triangles of rings [begin, end) of a joint batch, each kept by
+// the lowest ring it touches and indexed from that ring's first vertex
+template <typename VertexT>
+static void triangulateJoint(RegionBatch<VertexT>& batch, size_t begin, size_t end) {
+    const FlatElementList<VertexT>& elementList = *batch.elementList;
+    vector<pair<size_t, size_t>> rings;
+    for (size_t k = begin; k < end; k++) {
+        size_t ring = batch.rings[k];
+        rings.push_back({elementList.vertexOffsets[ring], elementList.vertexOffsets[ring + 1]});
+    }
+    vector<array<size_t, 3>> triangles;
+    triangulateRingsCDT(elementList.vertices.data(), rings, triangles, CDT::VertexInsertionOrder::Auto, RingFill::Union);
+
+    const vector<size_t>& offsets = elementList.vertexOffsets;
+    for (const auto& tri : triangles) {
+        size_t first = min(tri[0], min(tri[1], tri[2]));
+        size_t owner = upper_bound(offsets.begin(), offsets.end(), first) - offsets.begin() - 1;
+        batch.owners.push_back(owner);
+        batch.triangles.push_back({static_cast<int>(tri[0] - offsets[owner]), static_cast<int>(tri[1] - offsets[owner]),
+                                   static_cast<int>(tri[2] - offsets[owner])});
+    }
+    batch.stats.region += end - begin;
+}
+
+template <typename VertexT>
+static void triangulateBatch(RegionBatch<VertexT>& batch, const TriangulationOptions& options) {
+    const FlatElementList<VertexT>& elementList = *batch.elementList;
+    if (!batch.joint) {
+        for (size_t ring : batch.rings) {
+            size_t numTriangles = batch.triangles.size();
+            triangulateElement(elementList.elementVertices(ring), elementList.vertexCount(ring), batch.triangles, options, batch.stats);
+            batch.owners.insert(batch.owners.end(), batch.triangles.size() - numTriangles, ring);
+        }
+        return;
+    }
+
+    // Crossing rings were sent to lone batches, but a ring whose own edges
+    // cross would still need new vertices, which a ring cannot take, so a
+    // failing batch is retried region by region and a failing region falls
+    // back to one triangulation per ring
+    try {
+        triangulateJoint(batch, 0, batch.rings.size());
+        return;
+    } catch (const CDT::IntersectingConstraintsError&) {
+        batch.owners.clear();
+        batch.triangles.clear();
+        batch.stats = TriangulationStats();
+    }
+    size_t begin = 0;
+    for (size_t end : batch.regionEnds) {
+        size_t numTriangles = batch.triangles.size();
+        try {
+            triangulateJoint(batch, begin, end);
+        } catch (const CDT::IntersectingConstraintsError&) {
+            batch.owners.resize(numTriangles);
+            batch.triangles.resize(numTriangles);
+            for (size_t k = begin; k < end; k++) {
+                size_t ring = batch.rings[k];
+                size_t ringTriangles = batch.triangles.size();
+                triangulateElement(elementList.elementVertices(ring), elementList.vertexCount(ring), batch.triangles, options, batch.stats);
+                batch.owners.insert(batch.owners.end(), batch.triangles.size() - ringTriangles, ring);
+            }
+        }
+        begin = end;
+    }
+}
+
+// Triangulates every list region by region and reports which path each ring took
+template <typename VertexT>
+TriangulationStats triangulateRegions(const vector<FlatElementList<VertexT>*>& elementLists, const TriangulationOptions& options) {
+    vector<RegionBatch<VertexT>> batches;
+    for (FlatElementList<VertexT>* elementList : elementLists) {
+        collectBatches(*elementList, batches);
+    }
+
+    int maxThreads = options.numThreads > 0 ? options.numThreads : tbb::info::default_concurrency();
+    tbb::global_control threadLimit(tbb::global_control::max_allowed_parallelism, maxThreads);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, batches.size(), 1),
+        [&batches, &options](const tbb::blocked_range<size_t>& range) {
+            for (size_t i = range.begin(); i != range.end(); i++) {
+                triangulateBatch(batches[i], options);
+            }
+        }
+    );
+
+    // Triangles are bucketed by the ring that keeps them, in batch order, so
+    // the result does not depend on scheduling
+    TriangulationStats stats;
+    auto batch = batches.begin();
+    for (FlatElementList<VertexT>* elementList : elementLists) {
+        size_t numRings = elementList->size();
+        vector<size_t> cursor(numRings + 1, 0);
+        auto first = batch;
+        for (; batch != batches.end() && batch->elementList == elementList; ++batch) {
+            for (size_t owner : batch->owners) {
+                cursor[owner + 1]++;
+            }
+            stats += batch->stats;
+        }
+        partial_sum(cursor.begin(), cursor.end(), cursor.begin());
+        elementList->triangleOffsets = cursor;
+        elementList->triangles.resize(cursor.back());
+        for (auto it = first; it != batch; ++it) {
+            for (size_t k = 0; k < it->owners.size(); k++) {
+                elementList->triangles[cursor[it->owners[k]]++] = it->triangles[k];
+            }
+            TriangleList().swap(it->triangles);
+        }
+        for (size_t i = 0; i < numRings; i++) {
+            elementList->clockwise[i] = checkClockwise(elementList->elementVertices(i), elementList->vertexCount(i));
+        }
+    }
+    return stats;
+}
+
+template TriangulationStats triangulateRegions(const vector<ElementList2D*>&, const TriangulationOptions&);
+template TriangulationStats triangulateRegions(const vector<ElementListDB*>&, const TriangulationOptions&);
@@ -0,0 +1,279 @@
+// SpatialIndex.cpp
+
+#include "include/SpatialIndex.h"
+#include "include/lib/predicates.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Average number of elements per grid cell the grid is sized for
+static const double elementsPerCell = 4.0;
+
+// An empty polygon gets an empty box at the origin
+template <typename VertexT>
+BoundingBox polygonBounds(const VertexT* polygon, size_t numVertices) {
+    if (numVertices == 0) {
+        return BoundingBox();
+    }
+    BoundingBox box{double(polygon[0].x), double(polygon[0].y), double(polygon[0].x), double(polygon[0].y)};
+    for (size_t i = 1; i < numVertices; i++) {
+        box.xMin = min(box.xMin, double(polygon[i].x));
+        box.xMax = max(box.xMax, double(polygon[i].x));
+        box.yMin = min(box.yMin, double(polygon[i].y));
+        box.yMax = max(box.yMax, double(polygon[i].y));
+    }
+    return box;
+}
+
+template BoundingBox polygonBounds(const Vertex2D*, size_t);
+template BoundingBox polygonBounds(const VertexDB*, size_t);
+
+// Crossing-number test; keyhole slits cross twice and cancel out
+template <typename VertexT>
+bool containsPoint(const VertexT* polygon, size_t numVertices, double x, double y) {
+    bool inside = false;
+    for (size_t i = 0, j = numVertices - 1; i < numVertices; j = i++) {
+        double xi = polygon[i].x, yi = polygon[i].y, xj = polygon[j].x, yj = polygon[j].y;
+        if ((yi > y) != (yj > y) && x < (xj - xi) * (y - yi) / (yj - yi) + xi) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+template bool containsPoint(const Vertex2D*, size_t, double, double);
+template bool containsPoint(const VertexDB*, size_t, double, double);
+
+template <typename VertexT>
+void addEdgeCuts(const VertexT& a, const VertexT& b, const VertexT* polygon, size_t numVertices, size_t skip, vector<double>& cuts) {
+    double ex = double(b.x) - a.x, ey = double(b.y) - a.y;
+    double lengthSquared = ex * ex + ey * ey;
+    for (size_t f = 0; f < numVertices; f++) {
+        if (f == skip) {
+            continue;
+        }
+        const VertexT& c = polygon[f];
+        const VertexT& d = polygon[(f + 1) % numVertices];
+        double fx = double(d.x) - c.x, fy = double(d.y) - c.y;
+        double acx = double(c.x) - a.x, acy = double(c.y) - a.y;
+        double denominator = ex * fy - ey * fx;
+        if (denominator != 0) {
+            double t = (acx * fy - acy * fx) / denominator, u = (acx * ey - acy * ex) / denominator;
+            if (t > 0 && t < 1 && u >= 0 && u <= 1) {
+                cuts.push_back(t);
+            }
+        } else if (predicates::adaptive::orient2d<double>(a.x, a.y, b.x, b.y, c.x, c.y) == 0 &&
+                   predicates::adaptive::orient2d<double>(a.x, a.y, b.x, b.y, d.x, d.y) == 0) {
+            // Overlapping collinear edges: cut where the other edge starts and ends
+            for (const VertexT* v : {&c, &d}) {
+                double t = ((v->x - double(a.x)) * ex + (v->y - double(a.y)) * ey) / lengthSquared;
+                if (t > 0 && t < 1) {
+                    cuts.push_back(t);
+                }
+            }
+        }
+    }
+}
+
+template void addEdgeCuts(const Vertex2D&, const Vertex2D&, const Vertex2D*, size_t, size_t, vector<double>&);
+template void addEdgeCuts(const VertexDB&, const VertexDB&, const VertexDB*, size_t, size_t, vector<double>&);
+
+template <typename VertexT>
+LayerGrid::LayerGrid(const FlatElementList<VertexT>& elementList) {
+    size_t numElements = elementList.size();
+    bounds.reserve(numElements);
+    for (size_t i = 0; i < numElements; i++) {
+        bounds.push_back(polygonBounds(elementList.elementVertices(i), elementList.vertexCount(i)));
+    }
+    if (numElements == 0) {
+        cellOffsets.assign(2, 0);
+        return;
+    }
+
+    extent = bounds[0];
+    for (const BoundingBox& box : bounds) {
+        extent.xMin = min(extent.xMin, box.xMin);
+        extent.xMax = max(extent.xMax, box.xMax);
+        extent.yMin = min(extent.yMin, box.yMin);
+        extent.yMax = max(extent.yMax, box.yMax);
+    }
+
+    // Roughly square cells, about elementsPerCell elements each
+    double width = max(extent.xMax - extent.xMin, 1e-12);
+    double height = max(extent.yMax - extent.yMin, 1e-12);
+    double cellSide = sqrt(width * height * elementsPerCell / numElements);
+    columns = max<size_t>(1, min<size_t>(numElements, static_cast<size_t>(ceil(width / cellSide))));
+    rows = max<size_t>(1, min<size_t>(numElements, static_cast<size_t>(ceil(height / cellSide))));
+    cellWidth = width / columns;
+    cellHeight = height / rows;
+
+    // Counting pass, then fill: two walks over the boxes instead of per-cell vectors
+    cellOffsets.assign(columns * rows + 1, 0);
+    for (const BoundingBox& box : bounds) {
+        size_t column0, row0, column1, row1;
+        cellRange(box, column0, row0, column1, row1);
+        for (size_t row = row0; row <= row1; row++) {
+            for (size_t column = column0; column <= column1; column++) {
+                cellOffsets[row * columns + column + 1]++;
+            }
+        }
+    }
+    for (size_t cell = 0; cell < columns * rows; cell++) {
+        cellOffsets[cell + 1] += cellOffsets[cell];
+    }
+    cellElements.resize(cellOffsets.back());
+    vector<size_t> cursor(cellOffsets.begin(), cellOffsets.end() - 1);
+    for (size_t i = 0; i < numElements; i++) {
+        size_t column0, row0, column1, row1;
+        cellRange(bounds[i], column0, row0, column1, row1);
+        for (size_t row = row0; row <= row1; row++) {
+            for (size_t column = column0; column <= column1; column++) {
+                cellElements[cursor[row * columns + column]++] = static_cast<uint32_t>(i);
+            }
+        }
+    }
+}
+
+template LayerGrid::LayerGrid(const ElementList2D&);
+template LayerGrid::LayerGrid(const ElementListDB&);
+
+// Cells overlapped by box, clamped to the grid
+void LayerGrid::cellRange(const BoundingBox& box, size_t& column0, size_t& row0, size_t& column1, size_t& row1) const {
+    auto toCell = [](double coordinate, double origin, double step, size_t count) {
+        double cell = floor((coordinate - origin) / step);
+        return static_cast<size_t>(min(max(cell, 0.0), static_cast<double>(count - 1)));
+    };
+    column0 = toCell(box.xMin, extent.xMin, cellWidth, columns);
+    column1 = toCell(box.xMax, extent.xMin, cellWidth, columns);
+    row0 = toCell(box.yMin, extent.yMin, cellHeight, rows);
+    row1 = toCell(box.yMax, extent.yMin, cellHeight, rows);
+}
+
+vector<size_t> LayerGrid::query(const BoundingBox& window) const {
+    vector<size_t> hits;
+    if (bounds.empty() || !window.intersects(extent)) {
+        return hits;
+    }
+    size_t column0, row0, column1, row1;
+    cellRange(window, column0, row0, column1, row1);
+    for (size_t row = row0; row <= row1; row++) {
+        for (size_t column = column0; column <= column1; column++) {
+            size_t cell = row * columns + column;
+            for (size_t k = cellOffsets[cell]; k < cellOffsets[cell + 1]; k++) {
+                if (bounds[cellElements[k]].intersects(window)) {
+                    hits.push_back(cellElements[k]);
+                }
+            }
+        }
+    }
+    // Elements spanning several cells are found once per cell
+    sort(hits.begin(), hits.end());
+    hits.erase(unique(hits.begin(), hits.end()), hits.end());
+    return hits;
+}
+
+// Sutherland-Hodgman clipping against the four window edges. A concave
+// polygon that leaves and re-enters the window through the same edge comes
+// out as one polygon joined by zero-width runs along that edge; the
+// triangulation treats those as overlapping boundaries and leaves them empty.
+void clipPolygon(const Vertex2D* polygon, size_t numVertices, const BoundingBox& window, vector<Vertex2D>& clipped) {
+    vector<Vertex2D> input(polygon, polygon + numVertices);
+    clipped.clear();
+    for (int edge = 0; edge < 4 && !input.empty(); edge++) {
+        auto inside = [&](const Vertex2D& v) {
+            switch (edge) {
+            case 0: return v.x >= window.xMin;
+            case 1: return v.x <= window.xMax;
+            case 2: return v.y >= window.yMin;
+            default: return v.y <= window.yMax;
+            }
+        };
+        auto intersection = [&](const Vertex2D& a, const Vertex2D& b) {
+            if (edge < 2) {
+                double x = edge == 0 ? window.xMin : window.xMax;
+                return Vertex2D{x, a.y + (b.y - a.y) * (x - a.x) / (b.x - a.x)};
+            }
+            double y = edge == 2 ? window.yMin : window.yMax;
+            return Vertex2D{a.x + (b.x - a.x) * (y - a.y) / (b.y - a.y), y};
+        };
+
+        clipped.clear();
+        for (size_t i = 0; i < input.size(); i++) {
+            const Vertex2D& current = input[i];
+            const Vertex2D& previous = input[(i + input.size() - 1) % input.size()];
+            if (inside(current)) {
+                if (!inside(previous)) {
+                    clipped.push_back(intersection(previous, current));
+                }
+                clipped.push_back(current);
+            } else if (inside(previous)) {
+                clipped.push_back(intersection(previous, current));
+            }
+        }
+        input.swap(clipped);
+    }
+
+    // Intersections can land on existing vertices; the triangulation rejects repeats
+    clipped.clear();
+    for (const Vertex2D& v : input) {
+        if (clipped.empty() || v.x != clipped.back().x || v.y != clipped.back().y) {
+            clipped.push_back(v);
+        }
+    }
+    while (clipped.size() > 1 && clipped.front().x == clipped.back().x && clipped.front().y == clipped.back().y) {
+        clipped.pop_back();
+    }
+    // Polygons that only touch the window leave a flat sliver behind
+    double area = 0;
+    for (size_t i = 0; i < clipped.size(); i++) {
+        const Vertex2D& a = clipped[i];
+        const Vertex2D& b = clipped[(i + 1) % clipped.size()];
+        area += a.x * b.y - b.x * a.y;
+    }
+    if (clipped.size() < 3 || area == 0) {
+        clipped.clear();
+    }
+}
+
+// Copies out only the polygons whose bounding box meets the window, optionally
+// clipping those that cross its border. Like layerMapToElementList, each
+// PolygonList is released as soon as it has been read, so the full layout is
+// never converted.
+map<int, ElementList2D> extractWindow(map<int, PolygonList>& layerMap, const BoundingBox& window, bool clip) {
+    map<int, ElementList2D> windowMap;
+    vector<Vertex2D> clipped;
+    for (auto& layer : layerMap) {
+        ElementList2D selected;
+        for (const auto& coordinates : layer.second) {
+            size_t numVertices = coordinates.size() / 2;
+            if (numVertices == 0) {
+                continue;
+            }
+            // libGDSII polygons are interleaved x,y doubles, copied as Vertex2D like layerMapToElementList does
+            size_t start = selected.vertices.size();
+            selected.vertices.resize(start + numVertices);
+            memcpy(&selected.vertices[start], coordinates.data(), numVertices * sizeof(Vertex2D));
+            const Vertex2D* polygon = &selected.vertices[start];
+            BoundingBox bounds = polygonBounds(polygon, numVertices);
+            if (!window.intersects(bounds)) {
+                selected.vertices.resize(start);
+                continue;
+            }
+            if (clip && !window.contains(bounds)) {
+                clipPolygon(polygon, numVertices, window, clipped);
+                selected.vertices.resize(start);
+                if (clipped.empty()) {
+                    continue;
+                }
+                selected.vertices.insert(selected.vertices.end(), clipped.begin(), clipped.end());
+            }
+            selected.closeElement();
+        }
+        PolygonList().swap(layer.second);
+        if (selected.size() > 0) {
+            windowMap[layer.first] = move(selected);
+        }
+    }
+    return windowMap;
+}
@@ -0,0 +1,166 @@
+// TriangulationCache.cpp
+
+#include "include/TriangulationCache.h"
+
+#include <cmath>
+#include <cstring>
+
+// Identifies cache files, followed by the quantum and the entry count
+static const char cacheFileMagic[8] = {'G', 'D', 'S', 'T', 'R', 'I', 'C', '1'};
+
+size_t ShapeKeyHash::operator()(const ShapeKey& key) const {
+    // FNV-1a over the snapped coordinates
+    uint64_t hash = 14695981039346656037ull;
+    for (int64_t value : key.coordinates) {
+        hash ^= static_cast<uint64_t>(value);
+        hash *= 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+TriangulationCache::TriangulationCache(double quantum) : quantum(quantum) {}
+
+template <typename VertexT>
+size_t TriangulationCache::canonicalStart(const VertexT* polygon, size_t numVertices) {
+    size_t start = 0;
+    for (size_t i = 1; i < numVertices; i++) {
+        if (polygon[i].x < polygon[start].x || (polygon[i].x == polygon[start].x && polygon[i].y < polygon[start].y)) {
+            start = i;
+        }
+    }
+    return start;
+}
+
+template <typename VertexT>
+ShapeKey TriangulationCache::makeKey(const VertexT* polygon, size_t numVertices, size_t start) const {
+    ShapeKey key;
+    key.coordinates.reserve(2 * numVertices);
+    const VertexT& origin = polygon[start];
+    for (size_t i = 0; i < numVertices; i++) {
+        const VertexT& v = polygon[(start + i) % numVertices];
+        key.coordinates.push_back(llround((double(v.x) - origin.x) / quantum));
+        key.coordinates.push_back(llround((double(v.y) - origin.y) / quantum));
+    }
+    return key;
+}
+
+template size_t TriangulationCache::canonicalStart(const Vertex2D*, size_t);
+template size_t TriangulationCache::canonicalStart(const VertexDB*, size_t);
+template ShapeKey TriangulationCache::makeKey(const Vertex2D*, size_t, size_t) const;
+template ShapeKey TriangulationCache::makeKey(const VertexDB*, size_t, size_t) const;
+
+bool TriangulationCache::lookup(const ShapeKey& key, size_t start, TriangleList& triangles) const {
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        return false;
+    }
+    int numVertices = key.coordinates.size() / 2;
+    int offset = start;
+    for (const Triangle& t : it->second) {
+        triangles.push_back({(t.x + offset) % numVertices, (t.y + offset) % numVertices, (t.z + offset) % numVertices});
+    }
+    return true;
+}
+
+void TriangulationCache::store(ShapeKey key, size_t start, const Triangle* first, const Triangle* last) {
+    int numVertices = key.coordinates.size() / 2;
+    int offset = numVertices - static_cast<int>(start);
+    TriangleList canonical;
+    canonical.reserve(last - first);
+    for (const Triangle* t = first; t != last; ++t) {
+        canonical.push_back({(t->x + offset) % numVertices, (t->y + offset) % numVertices, (t->z + offset) % numVertices});
+    }
+    entries.emplace(std::move(key), std::move(canonical));
+}
+
+bool TriangulationCache::load(const string& filename) {
+    ifstream file(filename, ios::binary | ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+    uint64_t remaining = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+
+    char magic[sizeof(cacheFileMagic)];
+    double fileQuantum;
+    uint64_t numEntries;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&fileQuantum), sizeof(fileQuantum));
+    file.read(reinterpret_cast<char*>(&numEntries), sizeof(numEntries));
+    if (!file || memcmp(magic, cacheFileMagic, sizeof(magic)) != 0 || fileQuantum != quantum) {
+        cerr << "Ignoring incompatible triangulation cache: " << filename << endl;
+        return false;
+    }
+    remaining -= sizeof(magic) + sizeof(fileQuantum) + sizeof(numEntries);
+
+    // Reads a count of records of recordSize bytes, which must fit in the rest of the file
+    auto readCount = [&](uint64_t& count, size_t recordSize) {
+        if (remaining < sizeof(count)) {
+            return false;
+        }
+        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        remaining -= sizeof(count);
+        if (!file || count > remaining / recordSize) {
+            return false;
+        }
+        remaining -= count * recordSize;
+        return true;
+    };
+    // A damaged file is dropped whole rather than seeding the cache with bad triangles
+    auto reject = [&] {
+        cerr << "Ignoring damaged triangulation cache: " << filename << endl;
+        entries.clear();
+        return false;
+    };
+
+    for (uint64_t i = 0; i < numEntries; i++) {
+        uint64_t numCoordinates, numTriangles;
+        ShapeKey key;
+        TriangleList triangles;
+        if (!readCount(numCoordinates, sizeof(int64_t)) || numCoordinates % 2 != 0) {
+            return reject();
+        }
+        key.coordinates.resize(numCoordinates);
+        file.read(reinterpret_cast<char*>(key.coordinates.data()), numCoordinates * sizeof(int64_t));
+        if (!readCount(numTriangles, sizeof(Triangle))) {
+            return reject();
+        }
+        triangles.resize(numTriangles);
+        file.read(reinterpret_cast<char*>(triangles.data()), numTriangles * sizeof(Triangle));
+        if (!file) {
+            return reject();
+        }
+        int64_t numVertices = static_cast<int64_t>(numCoordinates / 2);
+        for (const Triangle& triangle : triangles) {
+            for (int64_t index : {triangle.x, triangle.y, triangle.z}) {
+                if (index < 0 || index >= numVertices) {
+                    return reject();
+                }
+            }
+        }
+        entries.emplace(std::move(key), std::move(triangles));
+    }
+    return true;
+}
+
+bool TriangulationCache::save(const string& filename) const {
+    ofstream file(filename, ios::binary);
+    if (!file.is_open()) {
+        cerr << "Failed to open the file: " << filename << endl;
+        return false;
+    }
+
+    uint64_t numEntries = entries.size();
+    file.write(cacheFileMagic, sizeof(cacheFileMagic));
+    file.write(reinterpret_cast<const char*>(&quantum), sizeof(quantum));
+    file.write(reinterpret_cast<const char*>(&numEntries), sizeof(numEntries));
+    for (const auto& entry : entries) {
+        uint64_t numCoordinates = entry.first.coordinates.size();
+        uint64_t numTriangles = entry.second.size();
+        file.write(reinterpret_cast<const char*>(&numCoordinates), sizeof(numCoordinates));
+        file.write(reinterpret_cast<const char*>(entry.first.coordinates.data()), numCoordinates * sizeof(int64_t));
+        file.write(reinterpret_cast<const char*>(&numTriangles), sizeof(numTriangles));
+        file.write(reinterpret_cast<const char*>(entry.second.data()), numTriangles * sizeof(Triangle));
+    }
+    return static_cast<bool>(file);
+}
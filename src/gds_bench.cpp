@@ -0,0 +1,204 @@
+// gds_bench.cpp
+//
+// Times the pipeline stages on the sample layouts and on generated layers and
+// reports throughput, so regressions show up before a build is rolled out.
+
+#include "include/GDSProcessor.h"
+#include "include/GDSStreamReader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <numeric>
+#include <random>
+
+#ifndef GDS_SAMPLES_DIR
+#define GDS_SAMPLES_DIR "build/GDS_samples"
+#endif
+
+struct BenchOptions {
+    int repeats = 5;
+    int numThreads = 1;
+    size_t syntheticPolygons = 200000;
+    vector<string> files;
+};
+
+// Summary of the repeated timings of one stage
+struct Timing {
+    double minimum, median, mean, stddev;
+};
+
+Timing summarize(vector<double> seconds) {
+    sort(seconds.begin(), seconds.end());
+    size_t n = seconds.size();
+    double mean = accumulate(seconds.begin(), seconds.end(), 0.0) / n;
+    double variance = 0;
+    for (double s : seconds) {
+        variance += (s - mean) * (s - mean);
+    }
+    double median = n % 2 ? seconds[n / 2] : 0.5 * (seconds[n / 2 - 1] + seconds[n / 2]);
+    return {seconds.front(), median, mean, n > 1 ? sqrt(variance / (n - 1)) : 0.0};
+}
+
+// Runs setup (untimed) then stage, repeats times
+template<typename Setup, typename Stage>
+Timing measure(int repeats, Setup&& setup, Stage&& stage) {
+    vector<double> seconds;
+    for (int r = 0; r < repeats; r++) {
+        setup();
+        auto start = chrono::steady_clock::now();
+        stage();
+        seconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    return summarize(seconds);
+}
+
+// One table row; the throughput is computed from the median
+void report(const string& input, const string& stage, const Timing& timing, double amount, const char* unit) {
+    cout << left << setw(28) << input << setw(22) << stage << right << fixed << setprecision(3)
+         << setw(11) << timing.median * 1e3 << setw(11) << timing.minimum * 1e3 << setw(11) << timing.mean * 1e3
+         << setw(10) << timing.stddev * 1e3 << setw(14) << setprecision(1) << amount / timing.median << " " << unit << endl;
+}
+
+size_t countPolygons(const map<int, ElementList2D>& layerMap) {
+    size_t count = 0;
+    for (const auto& layer : layerMap) {
+        count += layer.second.size();
+    }
+    return count;
+}
+
+size_t countTriangles(const map<int, ElementList2D>& layerMap) {
+    size_t count = 0;
+    for (const auto& layer : layerMap) {
+        count += layer.second.triangles.size();
+    }
+    return count;
+}
+
+// Random layers mixing rectangles, rectilinear L shapes and non-convex stars
+// on a grid, so that polygons do not overlap
+map<int, ElementList2D> makeSyntheticLayers(size_t numPolygons, int numLayers) {
+    mt19937 random(12345);
+    uniform_real_distribution<double> jitter(0.2, 0.45);
+    map<int, ElementList2D> layerMap;
+    size_t side = static_cast<size_t>(ceil(sqrt(static_cast<double>(numPolygons))));
+    for (size_t i = 0; i < numPolygons; i++) {
+        ElementList2D& elementList = layerMap[static_cast<int>(i % numLayers) + 1];
+        double cx = (i % side) + 0.5, cy = (i / side) + 0.5;
+        double w = jitter(random), h = jitter(random);
+        vector<Vertex2D>& v = elementList.vertices;
+        switch (i % 3) {
+        case 0:
+            v.insert(v.end(), {{cx - w, cy - h}, {cx + w, cy - h}, {cx + w, cy + h}, {cx - w, cy + h}});
+            break;
+        case 1:
+            v.insert(v.end(), {{cx - w, cy - h}, {cx + w, cy - h}, {cx + w, cy}, {cx, cy}, {cx, cy + h}, {cx - w, cy + h}});
+            break;
+        default:
+            for (int k = 0; k < 16; k++) {
+                double angle = 2 * M_PI * k / 16;
+                double radius = k % 2 ? 0.2 * jitter(random) : jitter(random);
+                v.push_back({cx + radius * cos(angle), cy + radius * sin(angle)});
+            }
+            break;
+        }
+        elementList.closeElement();
+    }
+    return layerMap;
+}
+
+// Times triangulation and PLY writing of an already extracted layout
+void benchGeometry(const string& input, const map<int, ElementList2D>& layers, const BenchOptions& options) {
+    TriangulationOptions triangulationOptions;
+    triangulationOptions.numThreads = options.numThreads;
+    size_t numPolygons = countPolygons(layers);
+
+    map<int, ElementList2D> layerMap;
+    Timing triangulation = measure(options.repeats, [&] { layerMap = layers; },
+                                   [&] { triangulatePolygons(layerMap, triangulationOptions); });
+    size_t numTriangles = countTriangles(layerMap);
+    report(input, "triangulatePolygons", triangulation, numPolygons, "polygons/s");
+    report(input, "", triangulation, numTriangles, "triangles/s");
+
+    // Extrusion only hands the element lists over to the prisms; the caps and
+    // side walls are generated while writing, which is what gets timed
+    map<int, PrismList> layerMap3D = extrudePolygons(layerMap, 0.0, 100.0);
+
+    const string plyName = "gds_bench.ply";
+    size_t bytesWritten = 0;
+    Timing writing = measure(options.repeats, [&] { bytesWritten = 0; }, [&] {
+        for (const auto& layer : layerMap3D) {
+            bytesWritten += writePLY(plyName, layerMap3D, layer.first);
+        }
+    });
+    remove(plyName.c_str());
+    report(input, "writePLY", writing, bytesWritten / 1e6, "MB/s");
+}
+
+void benchFile(const string& path, const BenchOptions& options) {
+    string input = path.substr(path.find_last_of('/') + 1);
+
+    map<int, ElementList2D> layerMap;
+    Timing reading = measure(options.repeats, [&] { layerMap.clear(); }, [&] {
+        GDSIIData* gdsIIData = readGDS(path.c_str());
+        map<int, PolygonList> layerPLMap = extractPolygons(gdsIIData);
+        layerMap = layerMapToElementList(layerPLMap);
+        delete gdsIIData;
+    });
+    size_t numPolygons = countPolygons(layerMap);
+    report(input, "readGDS+extract", reading, numPolygons, "polygons/s");
+
+    size_t streamed = 0;
+    Timing streaming = measure(options.repeats, [&] { streamed = 0; }, [&] {
+        GDSStreamReader reader(path.c_str());
+        reader.forEachPolygon([&](int, int, const Vertex2D*, size_t) { streamed++; });
+    });
+    report(input, "streamRead", streaming, streamed, "polygons/s");
+
+    benchGeometry(input, layerMap, options);
+}
+
+void printUsage(const char* programName) {
+    cerr << "Usage: " << programName << " [--repeats N] [--threads N] [--synthetic POLYGONS] [GDS files...]" << endl;
+    cerr << "  --repeats N          runs per stage (default 5)" << endl;
+    cerr << "  --threads N          triangulation threads (0 = all cores, default 1)" << endl;
+    cerr << "  --synthetic P        size of the generated layout, 0 to skip (default 200000)" << endl;
+    cerr << "Without files the checked-in samples are used." << endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--repeats" && i + 1 < argc) {
+            options.repeats = max(1, atoi(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.numThreads = atoi(argv[++i]);
+        } else if (arg == "--synthetic" && i + 1 < argc) {
+            options.syntheticPolygons = strtoull(argv[++i], nullptr, 10);
+        } else if (arg[0] != '-') {
+            options.files.push_back(arg);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.files.empty()) {
+        options.files = {string(GDS_SAMPLES_DIR) + "/example_for_deven.gds",
+                         string(GDS_SAMPLES_DIR) + "/opt20231114a007_000_000.gds"};
+    }
+
+    cout << options.repeats << " repeats, " << options.numThreads << " thread(s); times in ms" << endl;
+    cout << left << setw(28) << "Input" << setw(22) << "Stage" << right << setw(11) << "median" << setw(11) << "min"
+         << setw(11) << "mean" << setw(10) << "stddev" << setw(14) << "throughput" << endl;
+    for (const string& file : options.files) {
+        benchFile(file, options);
+    }
+    if (options.syntheticPolygons > 0) {
+        benchGeometry("synthetic-" + to_string(options.syntheticPolygons), makeSyntheticLayers(options.syntheticPolygons, 4), options);
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+// gds_check.cpp
+//
+// Checks the layer-wide (--regions) triangulation on small hand-built layers:
+// the caps must cover exactly the union of the polygons, with holes only
+// where a keyhole polygon leaves one.
+
+#include "include/GDSProcessor.h"
+#include "include/SpatialIndex.h"
+
+#include <cmath>
+#include <cstdio>
+
+struct RegionCase {
+    const char* name;
+    vector<vector<Vertex2D>> polygons;
+    double unionArea;
+    bool exact; // every triangle in one joint CDT, so no triangle overlaps another
+};
+
+static vector<Vertex2D> square(double x0, double y0, double x1, double y1) {
+    return {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+}
+
+static bool insideAny(const vector<vector<Vertex2D>>& polygons, double x, double y) {
+    for (const auto& polygon : polygons) {
+        if (containsPoint(polygon.data(), polygon.size(), x, y)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool insideTriangle(const Vertex2D& a, const Vertex2D& b, const Vertex2D& c, double x, double y) {
+    double d0 = (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+    double d1 = (c.x - b.x) * (y - b.y) - (c.y - b.y) * (x - b.x);
+    double d2 = (a.x - c.x) * (y - c.y) - (a.y - c.y) * (x - c.x);
+    return (d0 >= 0 && d1 >= 0 && d2 >= 0) || (d0 <= 0 && d1 <= 0 && d2 <= 0);
+}
+
+// Compares the triangulated caps with the union of the polygons at points
+// of a grid that misses every polygon edge, and the cap area with the union
+static bool check(const RegionCase& regionCase) {
+    map<int, ElementList2D> layerMap;
+    ElementList2D& elementList = layerMap[1];
+    for (const auto& polygon : regionCase.polygons) {
+        elementList.vertices.insert(elementList.vertices.end(), polygon.begin(), polygon.end());
+        elementList.closeElement();
+    }
+    TriangulationOptions options;
+    options.regions = true;
+    triangulatePolygons(layerMap, options);
+
+    vector<array<Vertex2D, 3>> triangles;
+    double area = 0;
+    for (size_t i = 0; i < elementList.size(); i++) {
+        const Vertex2D* base = elementList.vertices.data() + elementList.vertexOffsets[i];
+        for (size_t t = elementList.triangleOffsets[i]; t < elementList.triangleOffsets[i + 1]; t++) {
+            const Triangle& tri = elementList.triangles[t];
+            array<Vertex2D, 3> corners = {base[tri.x], base[tri.y], base[tri.z]};
+            area += fabs((corners[1].x - corners[0].x) * (corners[2].y - corners[0].y) -
+                         (corners[2].x - corners[0].x) * (corners[1].y - corners[0].y)) / 2;
+            triangles.push_back(corners);
+        }
+    }
+
+    size_t wrong = 0;
+    for (double x = -1.0 + 1.0 / 64; x < 13; x += 1.0 / 32) {
+        for (double y = -1.0 + 1.0 / 64; y < 13; y += 1.0 / 32) {
+            bool covered = false;
+            for (const auto& tri : triangles) {
+                covered = covered || insideTriangle(tri[0], tri[1], tri[2], x, y);
+            }
+            wrong += covered != insideAny(regionCase.polygons, x, y);
+        }
+    }
+    bool areaOk = !regionCase.exact || fabs(area - regionCase.unionArea) < 1e-9;
+    printf("%-18s %s (cap area %g, union %g, %zu points wrong)\n", regionCase.name, wrong == 0 && areaOk ? "ok" : "FAILED",
+           area, regionCase.unionArea, wrong);
+    return wrong == 0 && areaOk;
+}
+
+int main() {
+    // Outline [0,10]^2 with a [3,7]^2 hole cut through a slit along y = 5
+    vector<Vertex2D> keyhole = {{0, 0}, {10, 0}, {10, 5}, {7, 5}, {7, 3}, {3, 3}, {3, 7}, {7, 7}, {7, 5}, {10, 5}, {10, 10}, {0, 10}};
+
+    vector<RegionCase> cases = {
+        {"nested", {square(0, 0, 10, 10), square(1, 1, 9, 9)}, 100, true},
+        {"partly overlapping", {square(0, 0, 2, 1), square(1, 0, 3, 1)}, 3, true},
+        {"crossing", {square(0, 0, 10, 10), square(1, 1, 11, 11)}, 119, false},
+        {"edge-abutting", {square(0, 0, 1, 1), square(1, 0, 2, 1), square(0, 1, 2, 2)}, 4, true},
+        {"duplicate", {square(0, 0, 2, 2), square(0, 0, 2, 2)}, 4, true},
+        {"keyhole", {keyhole, square(10, 0, 12, 10)}, 104, true},
+        {"keyhole filled", {keyhole, square(3, 3, 7, 7)}, 100, true},
+    };
+    int failures = 0;
+    for (const RegionCase& regionCase : cases) {
+        failures += !check(regionCase);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+// gds_flow.cpp
+//
+// Runs a process-flow recipe (see ProcessFlow.h) on in-memory level sets.
+// For example, the deposition planes of temp/vdb_manip.py become
+//
+//     voxel 0.02
+//     box layer0 -1,-1,-1 1,1,0
+//     box layer1 -1,-1,0 1,1,4
+//     box layer2 -1,-1,4 1,1,4.1
+//     write planes.vdb layer0 layer1 layer2
+
+#include "include/ProcessFlow.h"
+
+void printUsage(const char* programName) {
+    cerr << "Usage: " << programName << " [--threads N] <recipe file>" << endl;
+    cerr << "  --threads N      run independent steps on N threads (0 = all cores, default)" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    const char* recipeFileName = nullptr;
+    int numThreads = 0;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            numThreads = atoi(argv[++i]);
+        } else if (arg[0] != '-' && recipeFileName == nullptr) {
+            recipeFileName = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (recipeFileName == nullptr) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    openvdb::initialize();
+    ProcessFlow flow;
+    flow.load(recipeFileName);
+    flow.run(numThreads);
+    return 0;
+}
@@ -0,0 +1,375 @@
+// gds_generate.cpp
+//
+// Writes synthetic GDSII layouts for scaling tests: any number of layers and
+// polygons, rectangles or random non-convex shapes, keyhole polygons with
+// holes, and a chain of SREF/AREF levels multiplying the leaf cell. Records
+// are streamed through a buffer, so memory stays flat however large the file.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// GDSII record types written by the generator
+enum GDSRecordType {
+    HEADER = 0x00,
+    BGNLIB = 0x01,
+    LIBNAME = 0x02,
+    UNITS = 0x03,
+    ENDLIB = 0x04,
+    BGNSTR = 0x05,
+    STRNAME = 0x06,
+    ENDSTR = 0x07,
+    BOUNDARY = 0x08,
+    SREF = 0x0A,
+    AREF = 0x0B,
+    LAYER = 0x0D,
+    DATATYPE = 0x0E,
+    XY = 0x10,
+    ENDEL = 0x11,
+    SNAME = 0x12,
+    COLROW = 0x13,
+    STRANS = 0x1A,
+    ANGLE = 0x1C
+};
+
+// GDSII data types
+enum GDSDataType {
+    NO_DATA = 0x00,
+    BIT_ARRAY = 0x01,
+    INT16 = 0x02,
+    INT32 = 0x03,
+    REAL64 = 0x05,
+    ASCII = 0x06
+};
+
+enum class ShapeKind { Rectangles, NonConvex, Mixed };
+
+struct GeneratorOptions {
+    int layers = 4;
+    uint64_t polygons = 10000;
+    ShapeKind shapes = ShapeKind::Mixed;
+    double holeFraction = 0.0;
+    int depth = 0;
+    int columns = 2, rows = 2;
+    unsigned seed = 1;
+    string outputName;
+};
+
+// Pitch of the placement grid of the leaf polygons, in database units
+static const int32_t pitch = 1000;
+
+// Buffered big-endian GDSII record writer
+class GDSWriter {
+public:
+    explicit GDSWriter(const string& filename) : file(fopen(filename.c_str(), "wb")) {
+        if (!file) {
+            printf("error: could not create %s (aborting)\n", filename.c_str());
+            exit(1);
+        }
+        buffer.reserve(bufferSize);
+    }
+    ~GDSWriter() {
+        flush();
+        fclose(file);
+    }
+
+    uint64_t bytesWritten() const { return written + buffer.size(); }
+
+    void record(int type, int dataType, const void* payload = nullptr, size_t length = 0) {
+        size_t total = 4 + length;
+        put16(static_cast<uint16_t>(total));
+        buffer.push_back(static_cast<char>(type));
+        buffer.push_back(static_cast<char>(dataType));
+        if (length) {
+            const char* bytes = static_cast<const char*>(payload);
+            buffer.insert(buffer.end(), bytes, bytes + length);
+        }
+        if (buffer.size() >= bufferSize) {
+            flush();
+        }
+    }
+
+    void int16s(int type, const vector<int16_t>& values) {
+        vector<char> payload;
+        for (int16_t value : values) {
+            payload.push_back(static_cast<char>(value >> 8));
+            payload.push_back(static_cast<char>(value));
+        }
+        record(type, INT16, payload.data(), payload.size());
+    }
+
+    void real64s(int type, const vector<double>& values) {
+        vector<char> payload;
+        for (double value : values) {
+            uint64_t bits = toReal64(value);
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                payload.push_back(static_cast<char>(bits >> shift));
+            }
+        }
+        record(type, REAL64, payload.data(), payload.size());
+    }
+
+    void ascii(int type, const string& text) {
+        string padded = text;
+        if (padded.size() % 2) {
+            padded.push_back('\0');
+        }
+        record(type, ASCII, padded.data(), padded.size());
+    }
+
+    // XY record of a closed polygon: the first point is repeated at the end
+    void xy(const vector<int32_t>& coordinates, bool close) {
+        xyPayload.clear();
+        auto push = [&](int32_t value) {
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                xyPayload.push_back(static_cast<char>(value >> shift));
+            }
+        };
+        for (int32_t value : coordinates) {
+            push(value);
+        }
+        if (close) {
+            push(coordinates[0]);
+            push(coordinates[1]);
+        }
+        record(XY, INT32, xyPayload.data(), xyPayload.size());
+    }
+
+private:
+    static const size_t bufferSize = 1 << 22;
+
+    void put16(uint16_t value) {
+        buffer.push_back(static_cast<char>(value >> 8));
+        buffer.push_back(static_cast<char>(value));
+    }
+
+    void flush() {
+        fwrite(buffer.data(), 1, buffer.size(), file);
+        written += buffer.size();
+        buffer.clear();
+    }
+
+    // GDSII 8-byte real: sign bit, excess-64 base-16 exponent, 56-bit mantissa
+    static uint64_t toReal64(double value) {
+        if (value == 0) {
+            return 0;
+        }
+        uint64_t sign = value < 0 ? 0x80 : 0;
+        value = fabs(value);
+        int exponent = 64;
+        while (value >= 1) {
+            value /= 16;
+            exponent++;
+        }
+        while (value < 1.0 / 16) {
+            value *= 16;
+            exponent--;
+        }
+        uint64_t mantissa = static_cast<uint64_t>(ldexp(value, 56));
+        return ((sign | exponent) << 56) | mantissa;
+    }
+
+    FILE* file;
+    vector<char> buffer;
+    vector<char> xyPayload;
+    uint64_t written = 0;
+};
+
+// Cell at hierarchy level (0 = leaf holding the polygons)
+string cellName(int level) {
+    return "CELL" + to_string(level);
+}
+
+// Outline of one polygon centred in its grid slot. Shapes stay inside the
+// slot so that neighbours never overlap.
+void makeShape(ShapeKind kind, bool withHole, int32_t cx, int32_t cy, mt19937& random, vector<int32_t>& xy) {
+    uniform_int_distribution<int32_t> halfSize(pitch / 5, pitch * 9 / 20);
+    xy.clear();
+    int32_t w = halfSize(random), h = halfSize(random);
+    if (withHole) {
+        // Keyhole: the outer ring and the clockwise hole ring joined by a
+        // zero-width slit from the left edge, the usual GDSII encoding of a hole
+        int32_t hw = w / 2, hh = h / 2;
+        xy = {cx - w, cy - h, cx + w, cy - h, cx + w, cy + h, cx - w, cy + h,
+              cx - w, cy - hh, cx - hw, cy - hh, cx - hw, cy + hh, cx + hw, cy + hh,
+              cx + hw, cy - hh, cx - hw, cy - hh, cx - w, cy - hh};
+        return;
+    }
+    if (kind == ShapeKind::Rectangles) {
+        xy = {cx - w, cy - h, cx + w, cy - h, cx + w, cy + h, cx - w, cy + h};
+        return;
+    }
+    // Star-shaped around the centre, alternating long and short spokes
+    uniform_int_distribution<int> spokes(4, 16);
+    uniform_real_distribution<double> inner(0.15, 0.6);
+    int numSpokes = 2 * spokes(random);
+    for (int k = 0; k < numSpokes; k++) {
+        double angle = 2 * M_PI * k / numSpokes;
+        double radius = (k % 2 ? inner(random) : 1.0) * w;
+        xy.push_back(cx + static_cast<int32_t>(lround(radius * cos(angle))));
+        xy.push_back(cy + static_cast<int32_t>(lround(radius * sin(angle))));
+    }
+}
+
+void writeLeafCell(GDSWriter& writer, const GeneratorOptions& options, int32_t& width, int32_t& height) {
+    mt19937 random(options.seed);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    uint64_t side = static_cast<uint64_t>(ceil(sqrt(static_cast<double>(options.polygons))));
+    width = static_cast<int32_t>(side * pitch);
+    height = static_cast<int32_t>(((options.polygons + side - 1) / side) * pitch);
+
+    writer.int16s(BGNSTR, vector<int16_t>(12, 0));
+    writer.ascii(STRNAME, cellName(0));
+    vector<int32_t> xy;
+    for (uint64_t i = 0; i < options.polygons; i++) {
+        ShapeKind kind = options.shapes;
+        if (kind == ShapeKind::Mixed) {
+            kind = i % 2 ? ShapeKind::NonConvex : ShapeKind::Rectangles;
+        }
+        bool withHole = unit(random) < options.holeFraction;
+        makeShape(kind, withHole, static_cast<int32_t>((i % side) * pitch + pitch / 2),
+                  static_cast<int32_t>((i / side) * pitch + pitch / 2), random, xy);
+
+        writer.record(BOUNDARY, NO_DATA);
+        writer.int16s(LAYER, {static_cast<int16_t>(i % options.layers + 1)});
+        writer.int16s(DATATYPE, {0});
+        writer.xy(xy, true);
+        writer.record(ENDEL, NO_DATA);
+    }
+    writer.record(ENDSTR, NO_DATA);
+}
+
+// Level l places level l-1 as a columns x rows AREF plus one extra copy
+// rotated by 90 degrees and mirrored, next to the array
+void writeParentCell(GDSWriter& writer, const GeneratorOptions& options, int level, int32_t& width, int32_t& height) {
+    int32_t gap = pitch;
+    int32_t stepX = width + gap, stepY = height + gap;
+    writer.int16s(BGNSTR, vector<int16_t>(12, 0));
+    writer.ascii(STRNAME, cellName(level));
+
+    writer.record(AREF, NO_DATA);
+    writer.ascii(SNAME, cellName(level - 1));
+    writer.int16s(COLROW, {static_cast<int16_t>(options.columns), static_cast<int16_t>(options.rows)});
+    writer.xy({0, 0, options.columns * stepX, 0, 0, options.rows * stepY}, false);
+    writer.record(ENDEL, NO_DATA);
+
+    // Mirroring about x and then rotating by 90 degrees maps (x, y) onto (y, x),
+    // so the copy sits right of the array, as wide as the child is high
+    int32_t arrayWidth = options.columns * stepX;
+    writer.record(SREF, NO_DATA);
+    writer.ascii(SNAME, cellName(level - 1));
+    writer.int16s(STRANS, {static_cast<int16_t>(0x8000)});
+    writer.real64s(ANGLE, {90.0});
+    writer.xy({arrayWidth, 0}, false);
+    writer.record(ENDEL, NO_DATA);
+    writer.record(ENDSTR, NO_DATA);
+
+    int32_t childWidth = width, childHeight = height;
+    width = arrayWidth + childHeight;
+    height = max(options.rows * stepY, childWidth);
+}
+
+bool parseShapes(const string& text, ShapeKind& kind) {
+    if (text == "rect") {
+        kind = ShapeKind::Rectangles;
+    } else if (text == "nonconvex") {
+        kind = ShapeKind::NonConvex;
+    } else if (text == "mixed") {
+        kind = ShapeKind::Mixed;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void printUsage(const char* programName) {
+    cerr << "Usage: " << programName << " [options] -o FILE" << endl;
+    cerr << "  --layers N         spread polygons over N layers (default 4)" << endl;
+    cerr << "  --polygons M       polygons in the leaf cell (default 10000)" << endl;
+    cerr << "  --shapes KIND      rect, nonconvex or mixed (default mixed)" << endl;
+    cerr << "  --holes F          fraction of polygons written as keyholes with a hole (default 0)" << endl;
+    cerr << "  --depth D          hierarchy levels above the leaf cell (default 0, flat)" << endl;
+    cerr << "  --array CxR        AREF size used at every level (default 2x2)" << endl;
+    cerr << "  --seed S           random seed (default 1)" << endl;
+    cerr << "  -o FILE            output file (required)" << endl;
+    cerr << "Each level places its child (C*R + 1) times, so the flattened layout holds" << endl;
+    cerr << "M * (C*R + 1)^D polygons." << endl;
+}
+
+int main(int argc, char* argv[]) {
+    GeneratorOptions options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--layers" && hasValue) {
+            options.layers = max(1, atoi(argv[++i]));
+        } else if (arg == "--polygons" && hasValue) {
+            options.polygons = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--shapes" && hasValue) {
+            if (!parseShapes(argv[++i], options.shapes)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--holes" && hasValue) {
+            options.holeFraction = atof(argv[++i]);
+        } else if (arg == "--depth" && hasValue) {
+            options.depth = max(0, atoi(argv[++i]));
+        } else if (arg == "--array" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &options.columns, &options.rows) != 2 || options.columns < 1 || options.rows < 1) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "-o" && hasValue) {
+            options.outputName = argv[++i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.outputName.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Coordinates are 32-bit database units
+    double extent = ceil(sqrt(static_cast<double>(options.polygons))) * pitch *
+                    pow((max(options.columns, options.rows) + 2), options.depth);
+    if (extent > INT32_MAX) {
+        printf("error: layout would exceed 32-bit coordinates, reduce --polygons, --depth or --array (aborting)\n");
+        return 1;
+    }
+
+    uint64_t bytes;
+    {
+        GDSWriter writer(options.outputName);
+        writer.int16s(HEADER, {600});
+        writer.int16s(BGNLIB, vector<int16_t>(12, 0));
+        writer.ascii(LIBNAME, "SYNTHETIC");
+        // 1 nm database unit, 1 um user unit
+        writer.real64s(UNITS, {1e-3, 1e-9});
+
+        int32_t width, height;
+        writeLeafCell(writer, options, width, height);
+        for (int level = 1; level <= options.depth; level++) {
+            writeParentCell(writer, options, level, width, height);
+        }
+        writer.record(ENDLIB, NO_DATA);
+        bytes = writer.bytesWritten();
+    }
+
+    double placed = options.polygons * pow(options.columns * options.rows + 1, options.depth);
+    cout << "Wrote " << options.outputName << ": " << bytes << " bytes, " << options.polygons << " polygons in the leaf cell, "
+         << fixed << setprecision(0) << placed << " after flattening" << endl;
+    return 0;
+}
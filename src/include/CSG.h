@@ -0,0 +1,37 @@
+// CSG.h
+
+#ifndef CSG_H
+#define CSG_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <openvdb/openvdb.h>
+
+using namespace std;
+
+enum class CSGOperation { Union, Intersection, Difference };
+
+// Boolean expression over named grids. Leaves name a grid; inner nodes
+// combine their two operands.
+struct CSGExpression {
+    CSGOperation operation = CSGOperation::Union;
+    string grid;
+    unique_ptr<CSGExpression> left, right;
+
+    bool isLeaf() const { return !left; }
+};
+
+using GridLookup = function<openvdb::FloatGrid::ConstPtr(const string&)>;
+using GridSource = function<openvdb::FloatGrid::Ptr(size_t)>;
+
+// Function declarations
+openvdb::FloatGrid::Ptr csgCombine(CSGOperation operation, const openvdb::FloatGrid& a, const openvdb::FloatGrid& b);
+unique_ptr<CSGExpression> parseCSGExpression(const string& text, string& error);
+void csgGridNames(const CSGExpression& expression, vector<string>& names);
+openvdb::FloatGrid::Ptr evaluateCSG(const CSGExpression& expression, const GridLookup& lookup);
+openvdb::FloatGrid::Ptr csgReduce(CSGOperation operation, const vector<openvdb::FloatGrid::ConstPtr>& grids);
+openvdb::FloatGrid::Ptr csgReduce(CSGOperation operation, size_t numGrids, const GridSource& makeGrid);
+
+#endif // CSG_H
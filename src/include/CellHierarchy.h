@@ -0,0 +1,45 @@
+// CellHierarchy.h
+
+#ifndef CELLHIERARCHY_H
+#define CELLHIERARCHY_H
+
+#include <set>
+#include "GDSProcessor.h"
+
+// Placement of a cell inside its parent. An AREF is a columns x rows lattice
+// of placements, the lattice steps being given in the parent's frame.
+struct CellReference {
+    int cell;
+    Transform2D transform;
+    int columns = 1, rows = 1;
+    Vertex2D columnStep = {0, 0}, rowStep = {0, 0};
+};
+
+// One GDS structure. Its own polygons are kept once, in the cell's frame,
+// however many times the cell is placed. Extrusion moves them from layers
+// to extrudedLayers.
+struct Cell {
+    string name;
+    map<int, ElementList2D> layers;
+    map<int, PrismList> extrudedLayers;
+    vector<CellReference> references;
+    set<int> subtreeLayers; // layers of the cell and of every cell below it
+};
+
+struct CellHierarchy {
+    vector<Cell> cells;
+    vector<int> topCells; // cells that no other cell references
+
+    set<int> layers() const;
+    size_t uniquePolygonCount() const;
+    size_t placedPolygonCount() const;
+};
+
+// Function declarations
+CellHierarchy extractHierarchy(GDSIIData* gdsIIData);
+TriangulationStats triangulateHierarchy(CellHierarchy& hierarchy, const TriangulationOptions& options = {});
+void extrudeHierarchy(CellHierarchy& hierarchy, double zMin, double zMax);
+void forEachPlacement(const CellHierarchy& hierarchy, int layerNumber, const PLYInstanceVisitor& visit);
+size_t writeHierarchyPLY(const string& filename, const CellHierarchy& hierarchy, int layerNumber, PLYFormat format = PLYFormat::Binary);
+
+#endif // CELLHIERARCHY_H
@@ -0,0 +1,24 @@
+// FastTriangulation.h
+
+#ifndef FASTTRIANGULATION_H
+#define FASTTRIANGULATION_H
+
+#include "GDSProcessor.h"
+
+// Shape classes that decide which triangulation path a polygon takes
+enum class PolygonClass {
+    Rectangle,   // axis-aligned rectangle, two triangles in closed form
+    Convex,      // strictly convex polygon, triangle fan
+    Rectilinear, // non-convex polygon with axis-aligned edges, ear clipping
+    General      // everything else, constrained Delaunay triangulation
+};
+
+// Largest rectilinear polygon handed to the ear clipper, bigger ones go to the CDT
+const size_t maxEarClippingVertices = 64;
+
+// Function declarations
+template <typename VertexT> PolygonClass classifyPolygon(const VertexT* polygon, size_t numVertices);
+template <typename VertexT> void triangulateConvex(const VertexT* polygon, size_t numVertices, TriangleList& triangles);
+template <typename VertexT> bool triangulateByEarClipping(const VertexT* polygon, size_t numVertices, TriangleList& triangles);
+
+#endif // FASTTRIANGULATION_H
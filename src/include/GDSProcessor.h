@@ -3,8 +3,11 @@
 #ifndef GDSPROCESSOR_H
 #define GDSPROCESSOR_H
 
+#include <array>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <functional>
 #include <vector>
 #include <map>
 #include <string>
@@ -18,48 +21,189 @@ using namespace libGDSII;
 struct Vertex2D {
     double x, y;
 };
-struct Vertex3D {
-    double x, y, z;
+// Vertex in GDSII database units, exactly as stored in the file
+struct VertexDB {
+    int32_t x, y;
 };
 struct Triangle { 
     int x, y, z;
 };
 
-typedef vector<Vertex2D> Polygon2D;
-typedef vector<Vertex3D> Polygon3D;
 typedef vector<Triangle> TriangleList; 
 
-struct Element2D { 
-    Polygon2D polygon2D;
-    TriangleList triangles; 
-    bool clockwise;
+// Arithmetic for twice the signed area of vertices: exact 64-bit integers for
+// database units, whose magnitude is kept below maxDatabaseCoordinate
+template <typename VertexT> struct VertexTraits;
+template <> struct VertexTraits<Vertex2D> {
+    typedef double Area;
 };
-struct Element3D { 
-    Polygon3D polygon3D;
-    TriangleList triangles; 
-    bool clockwise;
+template <> struct VertexTraits<VertexDB> {
+    typedef int64_t Area;
 };
+const int32_t maxDatabaseCoordinate = (1 << 30) - 1;
 
-typedef vector<Element2D> ElementList2D;
-typedef vector<Element3D> ElementList3D;
+// Affine map of the plane: x' = xx * x + xy * y + dx, y' = yx * x + yy * y + dy
+struct Transform2D {
+    double xx = 1, xy = 0, yx = 0, yy = 1, dx = 0, dy = 0;
 
-// Triangulation struct definitions
-struct CustomPoint2D {
-    double data[2];
+    Vertex2D apply(double x, double y) const { return {xx * x + xy * y + dx, yx * x + yy * y + dy}; }
+    bool isMirrored() const { return xx * yy - xy * yx < 0; }
+
+    // Applies inner first, then this transform
+    Transform2D operator*(const Transform2D& inner) const {
+        return {xx * inner.xx + xy * inner.yx, xx * inner.xy + xy * inner.yy,
+                yx * inner.xx + yy * inner.yx, yx * inner.xy + yy * inner.yy,
+                xx * inner.dx + xy * inner.dy + dx, yx * inner.dx + yy * inner.dy + dy};
+    }
 };
 
-struct CustomEdge {
-    pair<int, int> vertices;
+// Flat storage for all elements (polygons) of one layer. Element i owns the
+// vertices [vertexOffsets[i], vertexOffsets[i + 1]) and the triangles
+// [triangleOffsets[i], triangleOffsets[i + 1]); triangle indices are local
+// to the element. A triangle of a region (an outline and its holes) is kept by
+// the region's first ring and may index past it into the rings that follow.
+// Coordinates are multiplied by unit only when they are written out.
+template <typename VertexT>
+struct FlatElementList {
+    vector<VertexT> vertices;
+    TriangleList triangles;
+    vector<size_t> vertexOffsets = {0};
+    vector<size_t> triangleOffsets = {0};
+    vector<bool> clockwise;
+    double unit = 1; // user units per coordinate unit
+
+    size_t size() const { return clockwise.size(); }
+    size_t vertexCount(size_t i) const { return vertexOffsets[i + 1] - vertexOffsets[i]; }
+    size_t triangleCount(size_t i) const { return triangleOffsets[i + 1] - triangleOffsets[i]; }
+    const VertexT* elementVertices(size_t i) const { return vertices.data() + vertexOffsets[i]; }
+    const Triangle* elementTriangles(size_t i) const { return triangles.data() + triangleOffsets[i]; }
+
+    // Appends all elements of another list after the current ones
+    void append(const FlatElementList& other) {
+        size_t vertexBase = vertices.size();
+        size_t triangleBase = triangles.size();
+        vertices.insert(vertices.end(), other.vertices.begin(), other.vertices.end());
+        triangles.insert(triangles.end(), other.triangles.begin(), other.triangles.end());
+        for (size_t i = 1; i < other.vertexOffsets.size(); i++) {
+            vertexOffsets.push_back(vertexBase + other.vertexOffsets[i]);
+            triangleOffsets.push_back(triangleBase + other.triangleOffsets[i]);
+        }
+        clockwise.insert(clockwise.end(), other.clockwise.begin(), other.clockwise.end());
+    }
+
+    // Closes the element made of the vertices and triangles appended since the previous one
+    void closeElement(bool isClockwise = false) {
+        vertexOffsets.push_back(vertices.size());
+        triangleOffsets.push_back(triangles.size());
+        clockwise.push_back(isClockwise);
+    }
+};
+
+typedef FlatElementList<Vertex2D> ElementList2D;
+typedef FlatElementList<VertexDB> ElementListDB;
+
+// Polygons of one layer extruded into prisms between zMin and zMax. Each ring
+// and its cap triangles are stored once; the bottom and top caps and the side
+// walls are generated while writing.
+template <typename VertexT>
+struct BasicPrismList {
+    FlatElementList<VertexT> base;
+    double zMin = 0, zMax = 0;
+
+    size_t vertexCount() const { return 2 * base.vertices.size(); }
+    // Two caps, plus two wall faces per ring edge
+    size_t faceCount() const { return 2 * base.triangles.size() + 2 * base.vertices.size(); }
+};
+
+typedef BasicPrismList<Vertex2D> PrismList;
+typedef BasicPrismList<VertexDB> PrismListDB;
+
+class TriangulationCache;
+
+// Settings of triangulatePolygons
+struct TriangulationOptions {
+    int numThreads = 1;                  // 1 runs serially, <= 0 uses every available core
+    bool fastPaths = true;               // closed-form and ear-clipping triangulation of simple shapes
+    TriangulationCache* cache = nullptr; // reuses triangulations of repeated shapes when set
+    bool regions = false;                // overlapping rings of a layer in one CDT filling their union
+};
+
+// Number of polygons that took each triangulation path
+struct TriangulationStats {
+    size_t rectangle = 0, convex = 0, rectilinear = 0, cdt = 0;
+    size_t region = 0; // rings triangulated together with the rings they overlap
+    size_t cacheHits = 0, cacheMisses = 0;
+
+    size_t total() const { return rectangle + convex + rectilinear + cdt + region + cacheHits; }
+    TriangulationStats& operator+=(const TriangulationStats& other);
+};
+
+// Which triangles of a joint triangulation of several rings are kept
+enum class RingFill {
+    EvenOdd, // inside an odd number of ring boundaries, as for one keyhole ring
+    Union    // inside any ring, so holes come only from keyholes
+};
+
+// Encoding of the body of a PLY file
+enum class PLYFormat {
+    Ascii,
+    Binary
+};
+
+// Visits one placement of an extruded layer
+typedef function<void(const PrismList&, const Transform2D&)> PLYInstanceVisitor;
+// Calls the visitor once per placement, in a repeatable order
+typedef function<void(const PLYInstanceVisitor&)> PLYInstanceEnumerator;
+
+// Writes the file of one layer and returns the number of bytes written
+typedef function<size_t(int layerNumber)> LayerWriter;
+
+// Writes the PLY file of one layer from prism lists handed over one at a
+// time, so only the list being written is in memory. Vertex, cap and wall
+// records go to three files next to the output, which are joined under the
+// header by finish() once the counts are known; the file matches what
+// writePLY writes for all the lists appended together.
+class PLYStreamWriter {
+public:
+    PLYStreamWriter(const string& filename, PLYFormat format);
+    ~PLYStreamWriter();
+    PLYStreamWriter(const PLYStreamWriter&) = delete;
+    PLYStreamWriter& operator=(const PLYStreamWriter&) = delete;
+
+    void write(const PrismList& prisms);
+    // Writes the file and returns the number of bytes written
+    size_t finish();
+
+private:
+    string filename;
+    PLYFormat format;
+    ofstream vertexFile, capFile, wallFile;
+    size_t numVertices = 0, numFaces = 0;
 };
 
 // Function declarations
 GDSIIData* readGDS(const char* gdsFileName);
+Transform2D placementTransform(double angle, double magnification, bool reflected, double dx, double dy);
 map<int, PolygonList> extractPolygons(GDSIIData* gdsIIData);
 map<int, ElementList2D> layerMapToElementList(map<int, PolygonList>& layerMap);
-bool checkClockwise(Polygon2D polygon);
-void triangulatePolygons(map<int, ElementList2D>& layerMap);
-Polygon3D insertZ(const Polygon2D& polygon2D, double z);
-map<int, ElementList3D> extrudePolygons(map<int, ElementList2D>& layerMap, double zMin, double zMax);
-void writePLY(const string& filename, const map<int, ElementList3D>& extrudedLayerMap, int layerNumber);
+map<int, ElementListDB> extractElementListsDB(GDSIIData* gdsIIData);
+template <typename VertexT> bool checkClockwise(const VertexT* polygon, size_t numVertices);
+template <typename VertexT>
+void triangulateRingsCDT(const VertexT* vertices, const vector<pair<size_t, size_t>>& rings, vector<array<size_t, 3>>& triangles,
+                         CDT::VertexInsertionOrder::Enum insertionOrder, RingFill fill = RingFill::EvenOdd);
+template <typename VertexT> void triangulateElementCDT(const VertexT* polygon, size_t numVertices, TriangleList& triangles);
+template <typename VertexT>
+void triangulateElement(const VertexT* polygon, size_t numVertices, TriangleList& triangles, const TriangulationOptions& options, TriangulationStats& stats);
+template <typename VertexT>
+TriangulationStats triangulateElementLists(const vector<FlatElementList<VertexT>*>& elementLists, const TriangulationOptions& options = {});
+template <typename VertexT>
+TriangulationStats triangulatePolygons(map<int, FlatElementList<VertexT>>& layerMap, const TriangulationOptions& options = {});
+template <typename VertexT>
+map<int, BasicPrismList<VertexT>> extrudePolygons(map<int, FlatElementList<VertexT>>& layerMap, double zMin, double zMax);
+bool isLittleEndian();
+size_t writePLYInstances(const string& filename, const PLYInstanceEnumerator& forEachInstance, PLYFormat format = PLYFormat::Binary);
+size_t writePLY(const string& filename, const map<int, PrismList>& extrudedLayerMap, int layerNumber, PLYFormat format = PLYFormat::Binary);
+size_t writePLY(const string& filename, const map<int, PrismListDB>& extrudedLayerMap, int layerNumber, PLYFormat format = PLYFormat::Binary);
+map<int, size_t> writeLayersConcurrently(const map<int, size_t>& layerSizes, const LayerWriter& writeLayer, int maxStreams);
 
 #endif // GDSPROCESSOR_H
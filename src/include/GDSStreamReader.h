@@ -0,0 +1,62 @@
+// GDSStreamReader.h
+
+#ifndef GDSSTREAMREADER_H
+#define GDSSTREAMREADER_H
+
+#include <unordered_map>
+#include "GDSProcessor.h"
+#include "SpatialIndex.h"
+
+struct ProcessStack;
+
+// Receives one flattened polygon: its layer, datatype and vertices in user
+// units, without the closing point. The vertex buffer is reused between calls.
+typedef function<void(int layer, int datatype, const Vertex2D* polygon, size_t numVertices)> PolygonCallback;
+
+// Reads a GDSII stream file through a read-only memory map and walks its
+// records in place. Only the byte range of each structure is indexed, so the
+// reader's own memory does not grow with the amount of geometry in the file.
+class GDSStreamReader {
+public:
+    explicit GDSStreamReader(const char* gdsFileName);
+    ~GDSStreamReader();
+    GDSStreamReader(const GDSStreamReader&) = delete;
+    GDSStreamReader& operator=(const GDSStreamReader&) = delete;
+
+    // Size of a database unit in user units
+    double userUnit() const { return unit; }
+
+    // Flattens the layout on the fly: walks every top structure and every
+    // SREF/AREF placement below it, reporting BOUNDARY and BOX polygons in
+    // file order. With a window (user units), placements whose cell bounds
+    // miss it are skipped without being decoded; polygons of the cells that
+    // are walked still need filtering by the caller.
+    void forEachPolygon(const PolygonCallback& callback, const BoundingBox* window = nullptr) const;
+
+private:
+    struct StructRange {
+        size_t begin, end; // records between STRNAME and ENDSTR
+    };
+    struct Walk;
+
+    void indexStructures();
+    template <typename Visitor> void forEachElement(const StructRange& range, const Visitor& visit) const;
+    BoundingBox structureBounds(const StructRange& range, int depth, Walk& walk) const;
+    void walkStructure(const StructRange& range, const Transform2D& transform, int depth, Walk& walk) const;
+
+    string fileName;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    double unit = 1.0;
+    unordered_map<string, StructRange> structures;
+    vector<StructRange> topStructures;
+};
+
+// Function declarations
+TriangulationStats streamTriangulatedBatches(const GDSStreamReader& reader, const TriangulationOptions& options,
+                                             const function<void(int, ElementList2D&)>& consume, const BoundingBox* window = nullptr,
+                                             bool clip = false, const ProcessStack* stack = nullptr);
+map<int, ElementList2D> streamTriangulatedPolygons(const GDSStreamReader& reader, const TriangulationOptions& options, TriangulationStats& stats,
+                                                   const BoundingBox* window = nullptr, bool clip = false, const ProcessStack* stack = nullptr);
+
+#endif // GDSSTREAMREADER_H
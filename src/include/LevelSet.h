@@ -0,0 +1,20 @@
+// LevelSet.h
+
+#ifndef LEVELSET_H
+#define LEVELSET_H
+
+#include <openvdb/openvdb.h>
+#include "GDSProcessor.h"
+
+// Settings of prismsToLevelSet
+struct LevelSetOptions {
+    double voxelSize = 0.01; // user units per voxel
+    float halfWidth = 3.0f;  // narrow band half width, in voxels
+};
+
+// Function declarations
+openvdb::FloatGrid::Ptr prismsToLevelSet(const PrismList& prisms, const LevelSetOptions& options);
+openvdb::GridPtrVec layersToLevelSets(const map<int, PrismList>& layerMap3D, const function<string(int)>& gridName, const LevelSetOptions& options);
+openvdb::FloatGrid::Ptr layersToMask(const map<int, PrismList>& layerMap3D, const LevelSetOptions& options);
+
+#endif // LEVELSET_H
@@ -0,0 +1,76 @@
+// PipelineStats.h
+
+#ifndef PIPELINESTATS_H
+#define PIPELINESTATS_H
+
+#include <chrono>
+#include "GDSProcessor.h"
+
+// Wall time of one pipeline stage and the process peak RSS once it finished
+struct StageRecord {
+    string name;
+    double seconds;
+    long peakRSSKiB;
+};
+
+struct LayerCounters {
+    size_t polygons = 0;
+    size_t vertices = 0;
+    size_t triangles = 0;
+    size_t bytesWritten = 0;
+};
+
+// Collects stage timings and per-layer counters for --stats. Callers hold a
+// pointer that is null when instrumentation is off, so a disabled run pays
+// one branch per stage and never reads the clock.
+class PipelineStats {
+public:
+    PipelineStats();
+
+    void recordStage(const string& name, double seconds);
+    // Adds the polygons, vertices and triangles of a 2D element list to a layer
+    template <typename VertexT> void countElements(int layerNumber, const FlatElementList<VertexT>& elementList);
+    void countBytesWritten(int layerNumber, size_t bytes) { layers[layerNumber].bytesWritten += bytes; }
+
+    void printTable(ostream& out) const;
+    void writeJSON(const string& filename) const;
+
+private:
+    chrono::steady_clock::time_point start;
+    vector<StageRecord> stages;
+    map<int, LayerCounters> layers;
+};
+
+// Times one stage for as long as it is in scope
+class StageTimer {
+public:
+    StageTimer(PipelineStats* stats, const char* name) : stats(stats), name(name) {
+        if (stats) {
+            start = chrono::steady_clock::now();
+        }
+    }
+    ~StageTimer() {
+        if (stats) {
+            stats->recordStage(name, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+    }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    PipelineStats* stats;
+    const char* name;
+    chrono::steady_clock::time_point start;
+};
+
+// Runs stage under a StageTimer and passes its result through
+template<typename Stage>
+auto timed(PipelineStats* stats, const char* name, Stage&& stage) -> decltype(stage()) {
+    StageTimer timer(stats, name);
+    return stage();
+}
+
+// Function declarations
+long peakRSSKiB();
+
+#endif // PIPELINESTATS_H
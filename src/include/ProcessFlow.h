@@ -0,0 +1,58 @@
+// ProcessFlow.h
+
+#ifndef PROCESSFLOW_H
+#define PROCESSFLOW_H
+
+#include <mutex>
+#include "LevelSet.h"
+
+// One recipe line. Every step writes at most one grid and reads any number.
+struct FlowStep {
+    int line = 0;
+    string operation;
+    string output;          // grid written by the step, empty for write
+    vector<string> inputs;  // grids read by the step
+    vector<string> args;    // the remaining arguments
+    LevelSetOptions levelSet; // voxel size and band in effect at this line
+};
+
+// Emulates a process flow on level sets kept in memory between steps. The
+// recipe is a text file with one step per line:
+//
+//     voxel V                           voxel size of the grids created below
+//     band W                            narrow band half width in voxels
+//     mask NAME GDS LAYER[/DT] Z0 T     extrude a layout layer between Z0 and Z0+T
+//     box NAME X0,Y0,Z0 X1,Y1,Z1        axis-aligned block, X0 < X1, Y0 < Y1, Z0 < Z1
+//     read NAME FILE.vdb [GRID]         load a grid, by default the first in the file
+//     deposit NAME BASE T               conformal film of thickness T over BASE
+//     etch TARGET TOOL                  TARGET = TARGET - TOOL
+//     planarize NAME Z                  cut NAME off above height Z
+//     union|intersect NAME A B...       CSG over any number of grids, on A's voxel size
+//     subtract NAME A B                 NAME = A - B
+//     csg NAME EXPRESSION               e.g. (A | B) - C & D, see CSG.h
+//     copy NAME A
+//     write FILE.vdb NAME...
+//
+// Steps are ordered by the grids they read and write; steps that do not
+// depend on each other run concurrently.
+class ProcessFlow {
+public:
+    void load(const string& recipeFileName);
+    void run(int numThreads);
+
+    // Grids are released after the level of their last reader, so while the
+    // recipe runs this finds only those that later steps still need
+    openvdb::FloatGrid::Ptr grid(const string& name) const;
+    const vector<FlowStep>& steps() const { return recipe; }
+
+private:
+    void execute(const FlowStep& step);
+    void store(const string& name, openvdb::FloatGrid::Ptr grid);
+
+    string recipeName;
+    vector<FlowStep> recipe;
+    map<string, openvdb::FloatGrid::Ptr> grids;
+    mutable mutex gridsMutex;
+};
+
+#endif // PROCESSFLOW_H
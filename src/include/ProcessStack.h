@@ -0,0 +1,42 @@
+// ProcessStack.h
+
+#ifndef PROCESSSTACK_H
+#define PROCESSSTACK_H
+
+#include "GDSProcessor.h"
+
+struct CellHierarchy;
+
+// One layer of the process stack: which GDS polygons it takes and where they sit in z
+struct StackLayer {
+    int layer = 0;
+    int datatype = -1; // -1 takes every datatype
+    string material;
+    double zBottom = 0;
+    double thickness = 0;
+
+    double zTop() const { return zBottom + thickness; }
+};
+
+// Stack layers in file order, which is also the order of the output files.
+// Once a layout is assigned to the stack its maps are keyed by the index of
+// the stack layer instead of the GDS layer number.
+struct ProcessStack {
+    vector<StackLayer> layers;
+
+    bool usesDatatypes() const;
+    // Indices of the stack layers taking polygons of layer/datatype
+    void findAll(int layer, int datatype, vector<int>& stackIndices) const;
+    string layerName(int stackIndex) const;
+};
+
+// Function declarations
+ProcessStack readProcessStack(const string& filename);
+template <typename VertexT>
+map<int, FlatElementList<VertexT>> assignStackLayers(map<int, FlatElementList<VertexT>>& layerMap, const ProcessStack& stack);
+void assignStackLayers(CellHierarchy& hierarchy, const ProcessStack& stack);
+template <typename VertexT>
+map<int, BasicPrismList<VertexT>> extrudeStack(map<int, FlatElementList<VertexT>>& stackMap, const ProcessStack& stack);
+void extrudeStack(CellHierarchy& hierarchy, const ProcessStack& stack);
+
+#endif // PROCESSSTACK_H
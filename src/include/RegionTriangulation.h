@@ -0,0 +1,12 @@
+// RegionTriangulation.h
+
+#ifndef REGIONTRIANGULATION_H
+#define REGIONTRIANGULATION_H
+
+#include "GDSProcessor.h"
+
+// Function declarations
+template <typename VertexT>
+TriangulationStats triangulateRegions(const vector<FlatElementList<VertexT>*>& elementLists, const TriangulationOptions& options);
+
+#endif // REGIONTRIANGULATION_H
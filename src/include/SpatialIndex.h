@@ -0,0 +1,53 @@
+// SpatialIndex.h
+
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include "GDSProcessor.h"
+
+// Axis-aligned rectangle in user units
+struct BoundingBox {
+    double xMin = 0, yMin = 0, xMax = 0, yMax = 0;
+
+    bool intersects(const BoundingBox& other) const {
+        return xMin <= other.xMax && other.xMin <= xMax && yMin <= other.yMax && other.yMin <= yMax;
+    }
+    bool contains(const BoundingBox& other) const {
+        return xMin <= other.xMin && other.xMax <= xMax && yMin <= other.yMin && other.yMax <= yMax;
+    }
+};
+
+// Uniform grid over the bounding boxes of the elements of one layer. Each
+// element is listed in every cell its box overlaps; cells are stored in one
+// contiguous array addressed by per-cell offsets.
+class LayerGrid {
+public:
+    template <typename VertexT> explicit LayerGrid(const FlatElementList<VertexT>& elementList);
+
+    // Indices of the elements whose bounding box intersects the window, in
+    // ascending order
+    vector<size_t> query(const BoundingBox& window) const;
+
+    const BoundingBox& elementBounds(size_t i) const { return bounds[i]; }
+
+private:
+    void cellRange(const BoundingBox& box, size_t& column0, size_t& row0, size_t& column1, size_t& row1) const;
+
+    vector<BoundingBox> bounds;
+    BoundingBox extent;
+    size_t columns = 1, rows = 1;
+    double cellWidth = 1, cellHeight = 1;
+    vector<size_t> cellOffsets;
+    vector<uint32_t> cellElements;
+};
+
+// Function declarations
+template <typename VertexT> BoundingBox polygonBounds(const VertexT* polygon, size_t numVertices);
+template <typename VertexT> bool containsPoint(const VertexT* polygon, size_t numVertices, double x, double y);
+// Appends the parameters along a -> b at which the edges of the polygon cross
+// or touch it, skipping edge `skip` of the polygon
+template <typename VertexT> void addEdgeCuts(const VertexT& a, const VertexT& b, const VertexT* polygon, size_t numVertices, size_t skip, vector<double>& cuts);
+void clipPolygon(const Vertex2D* polygon, size_t numVertices, const BoundingBox& window, vector<Vertex2D>& clipped);
+map<int, ElementList2D> extractWindow(map<int, PolygonList>& layerMap, const BoundingBox& window, bool clip);
+
+#endif // SPATIALINDEX_H
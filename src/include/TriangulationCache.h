@@ -0,0 +1,52 @@
+// TriangulationCache.h
+
+#ifndef TRIANGULATIONCACHE_H
+#define TRIANGULATIONCACHE_H
+
+#include <cstdint>
+#include <tbb/concurrent_unordered_map.h>
+#include "GDSProcessor.h"
+
+// Shape of a polygon up to translation: its vertices relative to the
+// lowest-leftmost one, starting from that vertex, snapped to a grid
+struct ShapeKey {
+    vector<int64_t> coordinates;
+
+    bool operator==(const ShapeKey& other) const { return coordinates == other.coordinates; }
+};
+
+struct ShapeKeyHash {
+    size_t operator()(const ShapeKey& key) const;
+};
+
+// Thread-safe store of triangulations of polygon shapes that repeat across a
+// layout at different offsets. Triangles are kept with indices relative to the
+// canonical start vertex, so they map onto any translated copy.
+class TriangulationCache {
+public:
+    // quantum is the grid, in the units of the vertex coordinates, the shapes
+    // are compared on
+    explicit TriangulationCache(double quantum = 1e-6);
+
+    // Index of the canonical start vertex: lowest x, then lowest y
+    template <typename VertexT> static size_t canonicalStart(const VertexT* polygon, size_t numVertices);
+    template <typename VertexT> ShapeKey makeKey(const VertexT* polygon, size_t numVertices, size_t start) const;
+
+    // Appends the cached triangles of the shape, mapped to the polygon's own
+    // vertex indices. Returns false on a miss.
+    bool lookup(const ShapeKey& key, size_t start, TriangleList& triangles) const;
+    void store(ShapeKey key, size_t start, const Triangle* first, const Triangle* last);
+
+    // Persistence across runs. load() ignores files written with another quantum
+    // and leaves the cache empty if a file is damaged.
+    bool load(const string& filename);
+    bool save(const string& filename) const;
+
+    size_t size() const { return entries.size(); }
+
+private:
+    double quantum;
+    tbb::concurrent_unordered_map<ShapeKey, TriangleList, ShapeKeyHash> entries;
+};
+
+#endif // TRIANGULATIONCACHE_H
@@ -246,6 +246,7 @@ typedef std::vector<Edge> EdgeVec;                ///< Vector of edges
 typedef unordered_set<Edge> EdgeUSet;             ///< Hash table of edges
 typedef unordered_set<TriInd> TriIndUSet;         ///< Hash table of triangles
 typedef unordered_map<TriInd, TriInd> TriIndUMap; ///< Triangle hash map
+typedef std::vector<bool> TriIndFlags; ///< One bit per triangle index
 
 /// Triangulation triangle (counter-clockwise winding)
 /*
@@ -351,6 +352,16 @@ struct CDT_EXPORT PtLineLocation
 template <typename T>
 CDT_EXPORT T orient2D(const V2d<T>& p, const V2d<T>& v1, const V2d<T>& v2);
 
+/// Orient p against the edges v1-v2, v2-v3 and v3-v1 of a triangle at once
+/// (defined only with PREDICATES_BATCHED_SIMD)
+template <typename T>
+CDT_EXPORT void orient2DEdges(
+    const V2d<T>& p,
+    const V2d<T>& v1,
+    const V2d<T>& v2,
+    const V2d<T>& v3,
+    T orientations[3]);
+
 /// Check if point lies to the left of, to the right of, or on a line
 template <typename T>
 CDT_EXPORT PtLineLocation::Enum locatePointLine(
@@ -101,6 +101,28 @@ T orient2D(const V2d<T>& p, const V2d<T>& v1, const V2d<T>& v2)
     return predicates::adaptive::orient2d(v1.x, v1.y, v2.x, v2.y, p.x, p.y);
 }
 
+#ifdef PREDICATES_BATCHED_SIMD
+template <typename T>
+void orient2DEdges(
+    const V2d<T>& p,
+    const V2d<T>& v1,
+    const V2d<T>& v2,
+    const V2d<T>& v3,
+    T orientations[3])
+{
+    // the fourth input repeats the first to fill a whole vector block
+    const T ax[4] = {v1.x, v2.x, v3.x, v1.x};
+    const T ay[4] = {v1.y, v2.y, v3.y, v1.y};
+    const T bx[4] = {v2.x, v3.x, v1.x, v2.x};
+    const T by[4] = {v2.y, v3.y, v1.y, v2.y};
+    const T px[4] = {p.x, p.x, p.x, p.x};
+    const T py[4] = {p.y, p.y, p.y, p.y};
+    T out[4];
+    predicates::batched::orient2d(4, ax, ay, bx, by, px, py, out);
+    std::copy(out, out + 3, orientations);
+}
+#endif
+
 template <typename T>
 PtLineLocation::Enum locatePointLine(
     const V2d<T>& p,
@@ -129,14 +151,29 @@ PtTriLocation::Enum locatePointTriangle(
     const V2d<T>& v2,
     const V2d<T>& v3)
 {
-    using namespace predicates::adaptive;
+    // batched predicates test all edges at once, scalar ones are evaluated
+    // lazily up to the first Right edge
+#ifdef PREDICATES_BATCHED_SIMD
+    T orientations[3];
+    orient2DEdges(p, v1, v2, v3, orientations);
+#endif
     PtTriLocation::Enum result = PtTriLocation::Inside;
-    PtLineLocation::Enum edgeCheck = locatePointLine(p, v1, v2);
+    PtLineLocation::Enum edgeCheck =
+#ifdef PREDICATES_BATCHED_SIMD
+        classifyOrientation(orientations[0]);
+#else
+        locatePointLine(p, v1, v2);
+#endif
     if(edgeCheck == PtLineLocation::Right)
         return PtTriLocation::Outside;
     if(edgeCheck == PtLineLocation::OnLine)
         result = PtTriLocation::OnEdge1;
-    edgeCheck = locatePointLine(p, v2, v3);
+    edgeCheck =
+#ifdef PREDICATES_BATCHED_SIMD
+        classifyOrientation(orientations[1]);
+#else
+        locatePointLine(p, v2, v3);
+#endif
     if(edgeCheck == PtLineLocation::Right)
         return PtTriLocation::Outside;
     if(edgeCheck == PtLineLocation::OnLine)
@@ -144,7 +181,12 @@ PtTriLocation::Enum locatePointTriangle(
         result = (result == PtTriLocation::Inside) ? PtTriLocation::OnEdge2
                                                    : PtTriLocation::OnVertex;
     }
-    edgeCheck = locatePointLine(p, v3, v1);
+    edgeCheck =
+#ifdef PREDICATES_BATCHED_SIMD
+        classifyOrientation(orientations[2]);
+#else
+        locatePointLine(p, v3, v1);
+#endif
     if(edgeCheck == PtLineLocation::Right)
         return PtTriLocation::Outside;
     if(edgeCheck == PtLineLocation::OnLine)
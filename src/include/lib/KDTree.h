@@ -8,6 +8,7 @@
 #define KDTREE_KDTREE_H
 
 #include "CDTUtils.h"
+#include "portable_nth_element.hpp"
 
 #include <cassert>
 #include <limits>
@@ -29,8 +30,16 @@ struct NodeSplitDirection
 /// Simple tree structure with alternating half splitting nodes
 /// @details Simple tree structure
 ///          - Tree to incrementally add points to the structure.
+///          - Bulk-build a balanced tree over many points at once.
 ///          - Get the nearest point to a given input.
 ///          - Does not check for duplicates, expect unique points.
+///
+///          Incremental insertion splits full leaves at the middle of their
+///          box. A bulk build splits at the median along the longer side of
+///          the box and keeps the points of all its leaves, coordinates
+///          included, in one contiguous array, so queries scan leaves without
+///          touching the external point-buffer. Points added later go to
+///          per-leaf buffers as usual.
 /// @tparam TCoordType type used for storing point coordinate.
 /// @tparam NumVerticesInLeaf The number of points per leaf.
 /// @tparam InitialStackDepth initial size of stack depth for nearest query.
@@ -58,12 +67,19 @@ public:
     struct Node
     {
         children_type children; ///< two children if not leaf; {0,0} if leaf
-        point_data_vec data;    ///< points' data if leaf
+        coord_type split;       ///< split position if not leaf
+        NodeSplitDirection::Enum dir; ///< split direction
+        point_data_vec data;    ///< points inserted one by one if leaf
+        point_index bulkBegin;  ///< leaf's range of bulk-built points
+        point_index bulkEnd;
         /// Create empty leaf
-        Node()
+        explicit Node(const NodeSplitDirection::Enum dir_)
+            : split(0)
+            , dir(dir_)
+            , bulkBegin(0)
+            , bulkEnd(0)
         {
             setChildren(node_index(0), node_index(0));
-            data.reserve(NumVerticesInLeaf);
         }
         /// Children setter for convenience
         void setChildren(const node_index c1, const node_index c2)
@@ -76,12 +92,16 @@ public:
         {
             return children[0] == children[1];
         }
+        /// Number of points stored in a leaf
+        std::size_t leafSize() const
+        {
+            return data.size() + (bulkEnd - bulkBegin);
+        }
     };
 
     /// Default constructor
     KDTree()
-        : m_rootDir(NodeSplitDirection::X)
-        , m_min(point_type::make(
+        : m_min(point_type::make(
               -std::numeric_limits<coord_type>::max(),
               -std::numeric_limits<coord_type>::max()))
         , m_max(point_type::make(
@@ -91,19 +111,18 @@ public:
         , m_isRootBoxInitialized(false)
         , m_tasksStack(InitialStackDepth, NearestTask())
     {
-        m_root = addNewNode();
+        m_root = addNewNode(NodeSplitDirection::X, true);
     }
 
     /// Constructor with bounding box known in advance
     KDTree(const point_type& min, const point_type& max)
-        : m_rootDir(NodeSplitDirection::X)
-        , m_min(min)
+        : m_min(min)
         , m_max(max)
         , m_size(0)
         , m_isRootBoxInitialized(true)
         , m_tasksStack(InitialStackDepth, NearestTask())
     {
-        m_root = addNewNode();
+        m_root = addNewNode(NodeSplitDirection::X, true);
     }
 
     CDT::VertInd size() const
@@ -111,6 +130,102 @@ public:
         return m_size;
     }
 
+    /// Remove all points; the root box is found again from the next points.
+    /// @note node buffers are kept and reused by later insertions
+    void clear()
+    {
+        for(typename std::vector<Node>::iterator it = m_nodes.begin();
+            it != m_nodes.end();
+            ++it)
+        {
+            recycleData(it->data);
+        }
+        m_nodes.clear();
+        m_bulkData.clear();
+        m_min = point_type::make(
+            -std::numeric_limits<coord_type>::max(),
+            -std::numeric_limits<coord_type>::max());
+        m_max = point_type::make(
+            std::numeric_limits<coord_type>::max(),
+            std::numeric_limits<coord_type>::max());
+        m_size = 0;
+        m_isRootBoxInitialized = false;
+        m_root = addNewNode(NodeSplitDirection::X, true);
+    }
+
+    /// Remove all points and set the root box known in advance
+    /// @note node buffers are kept and reused by later insertions
+    void clear(const point_type& min, const point_type& max)
+    {
+        clear();
+        m_min = min;
+        m_max = max;
+        m_isRootBoxInitialized = true;
+    }
+
+    /// Replace the tree's contents with a balanced tree over all points
+    /// @note external point-buffer is used to reduce kd-tree's memory footprint
+    /// @param points external point-buffer, every point of which is added
+    void build(const std::vector<point_type>& points)
+    {
+        clear();
+        if(points.empty())
+            return;
+        m_bulkData.resize(points.size());
+        for(point_index i(0); i < point_index(points.size()); ++i)
+        {
+            m_bulkData[i] = value_type(points[i], i);
+        }
+        m_size = static_cast<CDT::VertInd>(points.size());
+        // the root leaf is given all points, so its box is theirs
+        m_nodes[m_root].bulkEnd = m_size;
+        initializeRootBox(points);
+
+        std::vector<BuildTask> tasks(1, BuildTask(m_root, 0, m_size, m_min, m_max));
+        while(!tasks.empty())
+        {
+            const BuildTask t = tasks.back();
+            tasks.pop_back();
+            const point_index len = t.end - t.begin;
+            if(len <= BulkLeafSize)
+            {
+                m_nodes[t.node].bulkBegin = t.begin;
+                m_nodes[t.node].bulkEnd = t.end;
+                continue;
+            }
+            // median along the longer side; points equal to the split may
+            // land on either side, which the closed child boxes allow
+            const NodeSplitDirection::Enum dir =
+                t.max.x - t.min.x >= t.max.y - t.min.y ? NodeSplitDirection::X
+                                                       : NodeSplitDirection::Y;
+            const point_index mid = t.begin + len / 2;
+            detail::portable_nth_element(
+                m_bulkData.begin() + t.begin,
+                m_bulkData.begin() + mid,
+                m_bulkData.begin() + t.end,
+                LessAlong(dir));
+            const coord_type split = dir == NodeSplitDirection::X
+                                         ? m_bulkData[mid].first.x
+                                         : m_bulkData[mid].first.y;
+            const NodeSplitDirection::Enum childDir = otherDirection(dir);
+            const node_index c1 = addNewNode(childDir, false);
+            const node_index c2 = addNewNode(childDir, false);
+            Node& n = m_nodes[t.node];
+            n.split = split;
+            n.dir = dir;
+            n.setChildren(c1, c2);
+            n.bulkBegin = n.bulkEnd = 0;
+
+            point_type childMax = t.max, childMin = t.min;
+            dir == NodeSplitDirection::X ? childMax.x = split
+                                         : childMax.y = split;
+            dir == NodeSplitDirection::X ? childMin.x = split
+                                         : childMin.y = split;
+            tasks.push_back(BuildTask(c2, mid, t.end, childMin, t.max));
+            tasks.push_back(BuildTask(c1, t.begin, mid, t.min, childMax));
+        }
+    }
+
     /// Insert a point into kd-tree
     /// @note external point-buffer is used to reduce kd-tree's memory footprint
     /// @param iPoint index of point in external point-buffer
@@ -129,21 +244,14 @@ public:
         node_index node = m_root;
         point_type min = m_min;
         point_type max = m_max;
-        NodeSplitDirection::Enum dir = m_rootDir;
-
-        // below: initialized only to suppress warnings
-        NodeSplitDirection::Enum newDir(NodeSplitDirection::X);
-        coord_type mid(0);
-        point_type newMin, newMax;
         while(true)
         {
             if(m_nodes[node].isLeaf())
             {
                 // add point if capacity is not reached
-                point_data_vec& pd = m_nodes[node].data;
-                if(pd.size() < NumVerticesInLeaf)
+                if(m_nodes[node].leafSize() < NumVerticesInLeaf)
                 {
-                    pd.push_back(iPoint);
+                    m_nodes[node].data.push_back(iPoint);
                     return;
                 }
                 // initialize bbox first time the root capacity is reached
@@ -153,31 +261,16 @@ public:
                     min = m_min;
                     max = m_max;
                 }
-                // split a full leaf node
-                calcSplitInfo(min, max, dir, mid, newDir, newMin, newMax);
-                const node_index c1 = addNewNode(), c2 = addNewNode();
-                Node& n = m_nodes[node];
-                n.setChildren(c1, c2);
-                point_data_vec& c1data = m_nodes[c1].data;
-                point_data_vec& c2data = m_nodes[c2].data;
-                // move node's points to children
-                for(pd_cit it = n.data.begin(); it != n.data.end(); ++it)
-                {
-                    whichChild(points[*it], mid, dir) == 0
-                        ? c1data.push_back(*it)
-                        : c2data.push_back(*it);
-                }
-                n.data = point_data_vec();
-            }
-            else
-            {
-                calcSplitInfo(min, max, dir, mid, newDir, newMin, newMax);
+                splitLeaf(node, min, max, points);
             }
             // add the point to a child
-            const std::size_t iChild = whichChild(points[iPoint], mid, dir);
-            iChild == 0 ? max = newMax : min = newMin;
-            node = m_nodes[node].children[iChild];
-            dir = newDir;
+            const Node& n = m_nodes[node];
+            const std::size_t iChild = whichChild(pos, n.split, n.dir);
+            if(n.dir == NodeSplitDirection::X)
+                iChild == 0 ? max.x = n.split : min.x = n.split;
+            else
+                iChild == 0 ? max.y = n.split : min.y = n.split;
+            node = n.children[iChild];
         }
     }
 
@@ -192,8 +285,7 @@ public:
         value_type out;
         int iTask = -1;
         coord_type minDistSq = std::numeric_limits<coord_type>::max();
-        m_tasksStack[++iTask] =
-            NearestTask(m_root, m_min, m_max, m_rootDir, minDistSq);
+        m_tasksStack[++iTask] = NearestTask(m_root, m_min, m_max, minDistSq);
         while(iTask != -1)
         {
             const NearestTask t = m_tasksStack[iTask--];
@@ -202,31 +294,33 @@ public:
             const Node& n = m_nodes[t.node];
             if(n.isLeaf())
             {
+                for(point_index i = n.bulkBegin; i != n.bulkEnd; ++i)
+                {
+                    const value_type& v = m_bulkData[i];
+                    visitNearest(point, v.first, v.second, minDistSq, out);
+                }
                 for(pd_cit it = n.data.begin(); it != n.data.end(); ++it)
                 {
-                    const point_type& p = points[*it];
-                    const coord_type distSq = CDT::distanceSquared(point, p);
-                    if(distSq < minDistSq)
-                    {
-                        minDistSq = distSq;
-                        out.first = p;
-                        out.second = *it;
-                    }
+                    visitNearest(point, points[*it], *it, minDistSq, out);
                 }
             }
             else
             {
-                coord_type mid(0);
-                NodeSplitDirection::Enum newDir;
-                point_type newMin, newMax;
-                calcSplitInfo(t.min, t.max, t.dir, mid, newDir, newMin, newMax);
-
-                const coord_type distToMid = t.dir == NodeSplitDirection::X
-                                                 ? (point.x - mid)
-                                                 : (point.y - mid);
+                point_type newMin = t.min, newMax = t.max;
+                coord_type distToMid;
+                if(n.dir == NodeSplitDirection::X)
+                {
+                    newMin.x = newMax.x = n.split;
+                    distToMid = point.x - n.split;
+                }
+                else
+                {
+                    newMin.y = newMax.y = n.split;
+                    distToMid = point.y - n.split;
+                }
                 const coord_type toMidSq = distToMid * distToMid;
 
-                const std::size_t iChild = whichChild(point, mid, t.dir);
+                const std::size_t iChild = whichChild(point, n.split, n.dir);
                 if(iTask + 2 >= static_cast<int>(m_tasksStack.size()))
                 {
                     m_tasksStack.resize(
@@ -235,17 +329,17 @@ public:
                 // node containing point should end up on top of the stack
                 if(iChild == 0)
                 {
-                    m_tasksStack[++iTask] = NearestTask(
-                        n.children[1], newMin, t.max, newDir, toMidSq);
-                    m_tasksStack[++iTask] = NearestTask(
-                        n.children[0], t.min, newMax, newDir, toMidSq);
+                    m_tasksStack[++iTask] =
+                        NearestTask(n.children[1], newMin, t.max, toMidSq);
+                    m_tasksStack[++iTask] =
+                        NearestTask(n.children[0], t.min, newMax, toMidSq);
                 }
                 else
                 {
-                    m_tasksStack[++iTask] = NearestTask(
-                        n.children[0], t.min, newMax, newDir, toMidSq);
-                    m_tasksStack[++iTask] = NearestTask(
-                        n.children[1], newMin, t.max, newDir, toMidSq);
+                    m_tasksStack[++iTask] =
+                        NearestTask(n.children[0], t.min, newMax, toMidSq);
+                    m_tasksStack[++iTask] =
+                        NearestTask(n.children[1], newMin, t.max, toMidSq);
                 }
             }
         }
@@ -253,14 +347,93 @@ public:
     }
 
 private:
-    /// Add a new node and return it's index in nodes buffer
-    node_index addNewNode()
+    /// Bulk-built leaves are half full, like leaves after a midpoint split,
+    /// leaving room for points inserted later
+    static const std::size_t BulkLeafSize = NumVerticesInLeaf / 2 > 0
+                                                ? NumVerticesInLeaf / 2
+                                                : 1;
+
+    /// Add a new leaf and return it's index in nodes buffer
+    /// @param reserve give the leaf room for a full set of inserted points
+    node_index addNewNode(const NodeSplitDirection::Enum dir, const bool reserve)
     {
         const node_index newNodeIndex = static_cast<node_index>(m_nodes.size());
-        m_nodes.push_back(Node());
+        m_nodes.push_back(Node(dir));
+        if(!m_spareData.empty())
+        {
+            m_nodes.back().data.swap(m_spareData.back());
+            m_spareData.pop_back();
+        }
+        else if(reserve)
+        {
+            m_nodes.back().data.reserve(NumVerticesInLeaf);
+        }
         return newNodeIndex;
     }
 
+    /// Keep a point buffer that is no longer needed for a later node
+    void recycleData(point_data_vec& data)
+    {
+        if(data.capacity() == 0)
+            return;
+        data.clear();
+        m_spareData.push_back(point_data_vec());
+        m_spareData.back().swap(data);
+    }
+
+    /// Split a full leaf at the middle of its box and move its points to
+    /// the two new children
+    void splitLeaf(
+        const node_index node,
+        const point_type& min,
+        const point_type& max,
+        const std::vector<point_type>& points)
+    {
+        const NodeSplitDirection::Enum dir = m_nodes[node].dir;
+        const coord_type split = dir == NodeSplitDirection::X
+                                     ? (min.x + max.x) / coord_type(2)
+                                     : (min.y + max.y) / coord_type(2);
+        const NodeSplitDirection::Enum childDir = otherDirection(dir);
+        const node_index c1 = addNewNode(childDir, true);
+        const node_index c2 = addNewNode(childDir, true);
+        Node& n = m_nodes[node];
+        n.split = split;
+        n.setChildren(c1, c2);
+        point_data_vec& c1data = m_nodes[c1].data;
+        point_data_vec& c2data = m_nodes[c2].data;
+        // move node's points to children
+        for(point_index i = n.bulkBegin; i != n.bulkEnd; ++i)
+        {
+            const value_type& v = m_bulkData[i];
+            whichChild(v.first, split, dir) == 0 ? c1data.push_back(v.second)
+                                                 : c2data.push_back(v.second);
+        }
+        for(pd_cit it = n.data.begin(); it != n.data.end(); ++it)
+        {
+            whichChild(points[*it], split, dir) == 0 ? c1data.push_back(*it)
+                                                     : c2data.push_back(*it);
+        }
+        n.bulkBegin = n.bulkEnd = 0;
+        recycleData(n.data);
+    }
+
+    /// Update the nearest point found so far with a leaf's point
+    static void visitNearest(
+        const point_type& point,
+        const point_type& p,
+        const point_index iPoint,
+        coord_type& minDistSq,
+        value_type& out)
+    {
+        const coord_type distSq = CDT::distanceSquared(point, p);
+        if(distSq < minDistSq)
+        {
+            minDistSq = distSq;
+            out.first = p;
+            out.second = iPoint;
+        }
+    }
+
     /// Test which child point belongs to after the split
     /// @returns 0 if first child, 1 if second child
     std::size_t whichChild(
@@ -272,33 +445,11 @@ private:
             dir == NodeSplitDirection::X ? point.x > split : point.y > split);
     }
 
-    /// Calculate split location, direction, and children boxes
-    static void calcSplitInfo(
-        const point_type& min,
-        const point_type& max,
-        const NodeSplitDirection::Enum dir,
-        coord_type& midOut,
-        NodeSplitDirection::Enum& newDirOut,
-        point_type& newMinOut,
-        point_type& newMaxOut)
+    static NodeSplitDirection::Enum
+    otherDirection(const NodeSplitDirection::Enum dir)
     {
-        newMaxOut = max;
-        newMinOut = min;
-        switch(dir)
-        {
-        case NodeSplitDirection::X:
-            midOut = (min.x + max.x) / coord_type(2);
-            newDirOut = NodeSplitDirection::Y;
-            newMinOut.x = midOut;
-            newMaxOut.x = midOut;
-            return;
-        case NodeSplitDirection::Y:
-            midOut = (min.y + max.y) / coord_type(2);
-            newDirOut = NodeSplitDirection::X;
-            newMinOut.y = midOut;
-            newMaxOut.y = midOut;
-            return;
-        }
+        return dir == NodeSplitDirection::X ? NodeSplitDirection::Y
+                                            : NodeSplitDirection::X;
     }
 
     /// Test if point is inside a box
@@ -311,31 +462,47 @@ private:
     }
 
     /// Extend a tree by creating new root with old root and a new node as
-    /// children
+    /// children. The box is doubled along an axis on which the point lies
+    /// outside, and the new root splits at the old box's side.
     void extendTree(const point_type& point)
     {
-        const node_index newRoot = addNewNode();
-        const node_index newLeaf = addNewNode();
-        switch(m_rootDir)
+        const bool alongX = point.x < m_min.x || point.x > m_max.x;
+        const NodeSplitDirection::Enum dir =
+            alongX ? NodeSplitDirection::X : NodeSplitDirection::Y;
+        const node_index newRoot = addNewNode(dir, false);
+        const node_index newLeaf = addNewNode(otherDirection(dir), true);
+        Node& root = m_nodes[newRoot];
+        if(alongX)
         {
-        case NodeSplitDirection::X:
-            m_rootDir = NodeSplitDirection::Y;
-            point.y < m_min.y ? m_nodes[newRoot].setChildren(newLeaf, m_root)
-                              : m_nodes[newRoot].setChildren(m_root, newLeaf);
-            if(point.y < m_min.y)
-                m_min.y -= m_max.y - m_min.y;
-            else if(point.y > m_max.y)
-                m_max.y += m_max.y - m_min.y;
-            break;
-        case NodeSplitDirection::Y:
-            m_rootDir = NodeSplitDirection::X;
-            point.x < m_min.x ? m_nodes[newRoot].setChildren(newLeaf, m_root)
-                              : m_nodes[newRoot].setChildren(m_root, newLeaf);
+            const coord_type width = m_max.x - m_min.x;
             if(point.x < m_min.x)
-                m_min.x -= m_max.x - m_min.x;
-            else if(point.x > m_max.x)
-                m_max.x += m_max.x - m_min.x;
-            break;
+            {
+                root.split = m_min.x;
+                root.setChildren(newLeaf, m_root);
+                m_min.x -= width;
+            }
+            else
+            {
+                root.split = m_max.x;
+                root.setChildren(m_root, newLeaf);
+                m_max.x += width;
+            }
+        }
+        else
+        {
+            const coord_type height = m_max.y - m_min.y;
+            if(point.y < m_min.y)
+            {
+                root.split = m_min.y;
+                root.setChildren(newLeaf, m_root);
+                m_min.y -= height;
+            }
+            else
+            {
+                root.split = m_max.y;
+                root.setChildren(m_root, newLeaf);
+                m_max.y += height;
+            }
         }
         m_root = newRoot;
     }
@@ -343,16 +510,18 @@ private:
     /// Calculate root's box enclosing all root points
     void initializeRootBox(const std::vector<point_type>& points)
     {
-        const point_data_vec& data = m_nodes[m_root].data;
-        m_min = points[data.front()];
+        const Node& root = m_nodes[m_root];
+        m_min = root.bulkBegin != root.bulkEnd
+                    ? m_bulkData[root.bulkBegin].first
+                    : points[root.data.front()];
         m_max = m_min;
-        for(pd_cit it = data.begin(); it != data.end(); ++it)
+        for(point_index i = root.bulkBegin; i != root.bulkEnd; ++i)
+        {
+            extendBox(m_bulkData[i].first);
+        }
+        for(pd_cit it = root.data.begin(); it != root.data.end(); ++it)
         {
-            const point_type& p = points[*it];
-            m_min = point_type::make(
-                std::min(m_min.x, p.x), std::min(m_min.y, p.y));
-            m_max = point_type::make(
-                std::max(m_max.x, p.x), std::max(m_max.y, p.y));
+            extendBox(points[*it]);
         }
         // Make sure bounding box does not have a zero size by adding padding:
         // zero-size bounding box cannot be extended properly
@@ -370,22 +539,64 @@ private:
         m_isRootBoxInitialized = true;
     }
 
-private:
+    void extendBox(const point_type& p)
+    {
+        m_min = point_type::make(std::min(m_min.x, p.x), std::min(m_min.y, p.y));
+        m_max = point_type::make(std::max(m_max.x, p.x), std::max(m_max.y, p.y));
+    }
+
+    /// Orders bulk points by one coordinate, for median splits
+    struct LessAlong
+    {
+        NodeSplitDirection::Enum dir;
+        explicit LessAlong(const NodeSplitDirection::Enum dir_)
+            : dir(dir_)
+        {}
+        bool operator()(const value_type& a, const value_type& b) const
+        {
+            return dir == NodeSplitDirection::X ? a.first.x < b.first.x
+                                                : a.first.y < b.first.y;
+        }
+    };
+
+    /// Range of bulk points still to be placed under a node
+    struct BuildTask
+    {
+        node_index node;
+        point_index begin, end;
+        point_type min, max;
+        BuildTask(
+            const node_index node_,
+            const point_index begin_,
+            const point_index end_,
+            const point_type& min_,
+            const point_type& max_)
+            : node(node_)
+            , begin(begin_)
+            , end(end_)
+            , min(min_)
+            , max(max_)
+        {}
+    };
+
     node_index m_root;
     std::vector<Node> m_nodes;
-    NodeSplitDirection::Enum m_rootDir;
+    /// points of bulk-built leaves with their coordinates, each leaf owning
+    /// one contiguous range
+    std::vector<value_type> m_bulkData;
     point_type m_min;
     point_type m_max;
     CDT::VertInd m_size;
 
     bool m_isRootBoxInitialized;
+    /// point buffers of nodes dropped by clear() or split, handed to new nodes
+    std::vector<point_data_vec> m_spareData;
 
     // used for nearest query
     struct NearestTask
     {
         node_index node;
         point_type min, max;
-        NodeSplitDirection::Enum dir;
         coord_type distSq;
         NearestTask()
         {}
@@ -393,12 +604,10 @@ private:
             const node_index node_,
             const point_type& min_,
             const point_type& max_,
-            const NodeSplitDirection::Enum dir_,
             const coord_type distSq_)
             : node(node_)
             , min(min_)
             , max(max_)
-            , dir(dir_)
             , distSq(distSq_)
         {}
     };
@@ -25,23 +25,15 @@ template <
 class LocatorKDTree
 {
 public:
-    /// Initialize KD-tree with points
+    /// Initialize KD-tree with points, bulk-building a balanced tree
     void initialize(const std::vector<V2d<TCoordType> >& points)
     {
-        typedef V2d<TCoordType> V2d_t;
-        V2d_t min = points.front();
-        V2d_t max = min;
-        typedef typename std::vector<V2d_t>::const_iterator Cit;
-        for(Cit it = points.begin(); it != points.end(); ++it)
-        {
-            min = V2d_t::make(std::min(min.x, it->x), std::min(min.y, it->y));
-            max = V2d_t::make(std::max(max.x, it->x), std::max(max.y, it->y));
-        }
-        m_kdTree = KDTree_t(min, max);
-        for(VertInd i(0); i < points.size(); ++i)
-        {
-            m_kdTree.insert(i, points);
-        }
+        m_kdTree.build(points);
+    }
+    /// Remove all points, keeping the tree's buffers for reuse
+    void clear()
+    {
+        m_kdTree.clear();
     }
     /// Add point to KD-tree
     void addPoint(const VertInd i, const std::vector<V2d<TCoordType> >& points)
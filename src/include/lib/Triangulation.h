@@ -251,8 +251,8 @@ private:
  *
  * @tparam T type of vertex coordinates (e.g., float, double)
  * @tparam TNearPointLocator class providing locating near point for efficiently
- * inserting new points. Provides methods: 'addPoint(vPos, iV)' and
- * 'nearPoint(vPos) -> iV'
+ * inserting new points. Provides methods: 'addPoint(vPos, iV)',
+ * 'nearPoint(vPos) -> iV' and, for reset(), 'clear()'
  */
 template <typename T, typename TNearPointLocator = LocatorKDTree<T> >
 class CDT_EXPORT Triangulation
@@ -488,6 +488,14 @@ public:
      */
     bool isFinalized() const;
 
+    /**
+     * Remove all vertices, triangles and constraints so that the object can
+     * triangulate new input, as if newly constructed with the same settings.
+     * @note allocated storage is kept, so reusing one object for many small
+     * triangulations avoids most allocations
+     */
+    void reset();
+
     /**
      * Calculate depth of each triangle in constraint triangulation. Supports
      * overlapping boundaries.
@@ -537,6 +545,12 @@ public:
      * @param removedTriangles indices of triangles to remove
      */
     void removeTriangles(const TriIndUSet& removedTriangles);
+    /**
+     * Remove triangles flagged for removal, in time linear in the number of
+     * triangles.
+     * @param removedTriangles flag per triangle index, set to remove it
+     */
+    void removeTriangles(const TriIndFlags& removedTriangles);
 
     /// Access internal vertex adjacent triangles
     TriIndVec& VertTrisInternal();
@@ -684,10 +698,13 @@ private:
     /**
      * Remove super-triangle (if used) and triangles with specified indices.
      * Adjust internal triangulation state accordingly.
-     * @removedTriangles indices of triangles to remove
+     * @removedTriangles flag per triangle index, set to remove it
      */
-    void finalizeTriangulation(const TriIndUSet& removedTriangles);
-    TriIndUSet growToBoundary(std::stack<TriInd> seeds) const;
+    void finalizeTriangulation(const TriIndFlags& removedTriangles);
+    TriIndFlags growToBoundary(std::stack<TriInd> seeds) const;
+    /// Move kept triangles to the front and drop the rest; returns the new
+    /// index of each triangle, noNeighbor for removed ones
+    TriIndVec compactTriangles(const TriIndFlags& removedTriangles);
     void fixEdge(const Edge& edge);
     void fixEdge(const Edge& edge, const Edge& originalEdge);
     /**
@@ -747,13 +764,15 @@ private:
      * @param seeds indices of seed triangles
      * @param layerDepth current layer's depth to mark triangles with
      * @param[in, out] triDepths depths of triangles
-     * @return triangles of the deeper layers that are adjacent to the peeled
-     * layer. To be used as seeds when peeling deeper layers.
+     * @param[in, out] seedsByDepth triangles of the deeper layers that are
+     * adjacent to the peeled layer, indexed by their depth. To be used as
+     * seeds when peeling deeper layers.
      */
-    unordered_map<TriInd, LayerDepth> peelLayer(
+    void peelLayer(
         std::stack<TriInd> seeds,
         LayerDepth layerDepth,
-        std::vector<LayerDepth>& triDepths) const;
+        std::vector<LayerDepth>& triDepths,
+        std::vector<std::vector<TriInd> >& seedsByDepth) const;
 
     void insertVertices_AsProvided(VertInd superGeomVertCount);
     void insertVertices_Randomized(VertInd superGeomVertCount);
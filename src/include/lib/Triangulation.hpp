@@ -9,6 +9,7 @@
 
 #include "Triangulation.h"
 #include "portable_nth_element.hpp"
+#include "predicates.h"
 
 #include <algorithm>
 #include <cassert>
@@ -97,34 +98,32 @@ void Triangulation<T, TNearPointLocator>::eraseDummies()
 {
     if(m_dummyTris.empty())
         return;
-    const TriIndUSet dummySet(m_dummyTris.begin(), m_dummyTris.end());
-    TriIndUMap triIndMap;
-    triIndMap[noNeighbor] = noNeighbor;
-    for(TriInd iT(0), iTnew(0); iT < TriInd(triangles.size()); ++iT)
+    TriIndFlags isDummy(triangles.size(), false);
+    for(std::vector<TriInd>::const_iterator it = m_dummyTris.begin();
+        it != m_dummyTris.end();
+        ++it)
     {
-        if(dummySet.count(iT))
-            continue;
-        triIndMap[iT] = iTnew;
-        triangles[iTnew] = triangles[iT];
-        iTnew++;
+        isDummy[*it] = true;
     }
-    triangles.erase(triangles.end() - dummySet.size(), triangles.end());
+    const TriIndVec triIndMap = compactTriangles(isDummy);
 
     // remap adjacent triangle indices for vertices
     for(TriIndVec::iterator iT = m_vertTris.begin(); iT != m_vertTris.end();
         ++iT)
     {
-        *iT = triIndMap[*iT];
+        if(*iT != noNeighbor)
+            *iT = triIndMap[*iT];
     }
     // remap neighbor indices for triangles
     for(TriangleVec::iterator t = triangles.begin(); t != triangles.end(); ++t)
     {
         NeighborsArr3& nn = t->neighbors;
         for(NeighborsArr3::iterator iN = nn.begin(); iN != nn.end(); ++iN)
-            *iN = triIndMap[*iN];
+            if(*iN != noNeighbor)
+                *iN = triIndMap[*iN];
     }
     // clear dummy triangles
-    m_dummyTris = std::vector<TriInd>();
+    m_dummyTris.clear();
 }
 
 template <typename T, typename TNearPointLocator>
@@ -133,11 +132,11 @@ void Triangulation<T, TNearPointLocator>::eraseSuperTriangle()
     if(m_superGeomType != SuperGeometryType::SuperTriangle)
         return;
     // find triangles adjacent to super-triangle's vertices
-    TriIndUSet toErase;
+    TriIndFlags toErase(triangles.size(), false);
     for(TriInd iT(0); iT < TriInd(triangles.size()); ++iT)
     {
         if(touchesSuperTriangle(triangles[iT]))
-            toErase.insert(iT);
+            toErase[iT] = true;
     }
     finalizeTriangulation(toErase);
 }
@@ -148,7 +147,7 @@ void Triangulation<T, TNearPointLocator>::eraseOuterTriangles()
     // make dummy triangles adjacent to super-triangle's vertices
     assert(m_vertTris[0] != noNeighbor);
     const std::stack<TriInd> seed(std::deque<TriInd>(1, m_vertTris[0]));
-    const TriIndUSet toErase = growToBoundary(seed);
+    const TriIndFlags toErase = growToBoundary(seed);
     finalizeTriangulation(toErase);
 }
 
@@ -156,12 +155,11 @@ template <typename T, typename TNearPointLocator>
 void Triangulation<T, TNearPointLocator>::eraseOuterTrianglesAndHoles()
 {
     const std::vector<LayerDepth> triDepths = calculateTriangleDepths();
-    TriIndUSet toErase;
-    toErase.reserve(triangles.size());
+    TriIndFlags toErase(triangles.size(), false);
     for(std::size_t iT = 0; iT != triangles.size(); ++iT)
     {
         if(triDepths[iT] % 2 == 0)
-            toErase.insert(static_cast<TriInd>(iT));
+            toErase[iT] = true;
     }
     finalizeTriangulation(toErase);
 }
@@ -173,22 +171,46 @@ inline Edge RemapNoSuperTriangle(const Edge& e)
 }
 
 template <typename T, typename TNearPointLocator>
-void Triangulation<T, TNearPointLocator>::removeTriangles(
-    const TriIndUSet& removedTriangles)
+TriIndVec Triangulation<T, TNearPointLocator>::compactTriangles(
+    const TriIndFlags& removedTriangles)
 {
-    if(removedTriangles.empty())
-        return;
-    // remove triangles and calculate triangle index mapping
-    TriIndUMap triIndMap;
-    for(TriInd iT(0), iTnew(0); iT < TriInd(triangles.size()); ++iT)
+    TriIndVec triIndMap(triangles.size(), noNeighbor);
+    TriInd iTnew(0);
+    for(TriInd iT(0); iT < TriInd(triangles.size()); ++iT)
     {
-        if(removedTriangles.count(iT))
+        if(removedTriangles[iT])
             continue;
         triIndMap[iT] = iTnew;
         triangles[iTnew] = triangles[iT];
         iTnew++;
     }
-    triangles.erase(triangles.end() - removedTriangles.size(), triangles.end());
+    triangles.resize(iTnew);
+    return triIndMap;
+}
+
+template <typename T, typename TNearPointLocator>
+void Triangulation<T, TNearPointLocator>::removeTriangles(
+    const TriIndUSet& removedTriangles)
+{
+    if(removedTriangles.empty())
+        return;
+    TriIndFlags flags(triangles.size(), false);
+    for(TriIndUSet::const_iterator it = removedTriangles.begin();
+        it != removedTriangles.end();
+        ++it)
+    {
+        flags[*it] = true;
+    }
+    removeTriangles(flags);
+}
+
+template <typename T, typename TNearPointLocator>
+void Triangulation<T, TNearPointLocator>::removeTriangles(
+    const TriIndFlags& removedTriangles)
+{
+    // remove triangles and calculate triangle index mapping; removed
+    // triangles map to noNeighbor
+    const TriIndVec triIndMap = compactTriangles(removedTriangles);
     // adjust triangles' neighbors
     for(TriInd iT(0); iT < triangles.size(); ++iT)
     {
@@ -197,11 +219,7 @@ void Triangulation<T, TNearPointLocator>::removeTriangles(
         NeighborsArr3& nn = t.neighbors;
         for(NeighborsArr3::iterator n = nn.begin(); n != nn.end(); ++n)
         {
-            if(removedTriangles.count(*n))
-            {
-                *n = noNeighbor;
-            }
-            else if(*n != noNeighbor)
+            if(*n != noNeighbor)
             {
                 *n = triIndMap[*n];
             }
@@ -223,10 +241,10 @@ const TriIndVec& Triangulation<T, TNearPointLocator>::VertTrisInternal() const
 
 template <typename T, typename TNearPointLocator>
 void Triangulation<T, TNearPointLocator>::finalizeTriangulation(
-    const TriIndUSet& removedTriangles)
+    const TriIndFlags& removedTriangles)
 {
     eraseDummies();
-    m_vertTris = TriIndVec();
+    m_vertTris.clear();
     // remove super-triangle
     if(m_superGeomType == SuperGeometryType::SuperTriangle)
     {
@@ -234,15 +252,17 @@ void Triangulation<T, TNearPointLocator>::finalizeTriangulation(
         // Edge re-mapping
         { // fixed edges
             EdgeUSet updatedFixedEdges;
+            updatedFixedEdges.reserve(fixedEdges.size());
             typedef CDT::EdgeUSet::const_iterator It;
             for(It e = fixedEdges.begin(); e != fixedEdges.end(); ++e)
             {
                 updatedFixedEdges.insert(RemapNoSuperTriangle(*e));
             }
-            fixedEdges = updatedFixedEdges;
+            fixedEdges.swap(updatedFixedEdges);
         }
         { // overlap count
             unordered_map<Edge, BoundaryOverlapCount> updatedOverlapCount;
+            updatedOverlapCount.reserve(overlapCount.size());
             typedef unordered_map<Edge, BoundaryOverlapCount>::const_iterator
                 It;
             for(It it = overlapCount.begin(); it != overlapCount.end(); ++it)
@@ -250,10 +270,11 @@ void Triangulation<T, TNearPointLocator>::finalizeTriangulation(
                 updatedOverlapCount.insert(std::make_pair(
                     RemapNoSuperTriangle(it->first), it->second));
             }
-            overlapCount = updatedOverlapCount;
+            overlapCount.swap(updatedOverlapCount);
         }
         { // split edges mapping
             unordered_map<Edge, EdgeVec> updatedPieceToOriginals;
+            updatedPieceToOriginals.reserve(pieceToOriginals.size());
             typedef unordered_map<Edge, EdgeVec>::const_iterator It;
             for(It it = pieceToOriginals.begin(); it != pieceToOriginals.end();
                 ++it)
@@ -267,7 +288,7 @@ void Triangulation<T, TNearPointLocator>::finalizeTriangulation(
                 updatedPieceToOriginals.insert(
                     std::make_pair(RemapNoSuperTriangle(it->first), ee));
             }
-            pieceToOriginals = updatedPieceToOriginals;
+            pieceToOriginals.swap(updatedPieceToOriginals);
         }
     }
     // remove other triangles
@@ -296,15 +317,15 @@ void Triangulation<T, TNearPointLocator>::initializedWithCustomSuperGeometry()
 }
 
 template <typename T, typename TNearPointLocator>
-TriIndUSet Triangulation<T, TNearPointLocator>::growToBoundary(
+TriIndFlags Triangulation<T, TNearPointLocator>::growToBoundary(
     std::stack<TriInd> seeds) const
 {
-    TriIndUSet traversed;
+    TriIndFlags traversed(triangles.size(), false);
     while(!seeds.empty())
     {
         const TriInd iT = seeds.top();
         seeds.pop();
-        traversed.insert(iT);
+        traversed[iT] = true;
         const Triangle& t = triangles[iT];
         for(Index i(0); i < Index(3); ++i)
         {
@@ -312,7 +333,7 @@ TriIndUSet Triangulation<T, TNearPointLocator>::growToBoundary(
             if(fixedEdges.count(opEdge))
                 continue;
             const TriInd iN = t.neighbors[opoNbr(i)];
-            if(iN != noNeighbor && traversed.count(iN) == 0)
+            if(iN != noNeighbor && !traversed[iN])
                 seeds.push(iN);
         }
     }
@@ -1459,15 +1480,31 @@ TriInd Triangulation<T, TNearPointLocator>::walkTriangles(
     {
         const Triangle& t = triangles[currTri];
         found = true;
+#ifdef PREDICATES_BATCHED_SIMD
+        // all three edges are tested in one batch of vector predicates
+        T orientations[3];
+        orient2DEdges(
+            pos,
+            vertices[t.vertices[0]],
+            vertices[t.vertices[1]],
+            vertices[t.vertices[2]],
+            orientations);
+#endif
         // stochastic offset to randomize which edge we check first
         const Index offset(prng() % 3);
         for(Index i_(0); i_ < Index(3); ++i_)
         {
             const Index i((i_ + offset) % 3);
+#ifdef PREDICATES_BATCHED_SIMD
+            const PtLineLocation::Enum edgeCheck =
+                classifyOrientation(orientations[i]);
+#else
+            // scalar predicates stop at the first edge the point is right of
             const V2d<T>& vStart = vertices[t.vertices[i]];
             const V2d<T>& vEnd = vertices[t.vertices[ccw(i)]];
             const PtLineLocation::Enum edgeCheck =
                 locatePointLine(pos, vStart, vEnd);
+#endif
             const TriInd iN = t.neighbors[i];
             if(edgeCheck == PtLineLocation::Right && iN != noNeighbor)
             {
@@ -1731,19 +1768,32 @@ bool Triangulation<T, TNearPointLocator>::isFinalized() const
 }
 
 template <typename T, typename TNearPointLocator>
-unordered_map<TriInd, LayerDepth>
-Triangulation<T, TNearPointLocator>::peelLayer(
+void Triangulation<T, TNearPointLocator>::reset()
+{
+    vertices.clear();
+    triangles.clear();
+    fixedEdges.clear();
+    overlapCount.clear();
+    pieceToOriginals.clear();
+    m_dummyTris.clear();
+    m_vertTris.clear();
+    m_nearPtLocator.clear();
+    m_nTargetVerts = detail::defaults::nTargetVerts;
+    m_superGeomType = detail::defaults::superGeomType;
+}
+
+template <typename T, typename TNearPointLocator>
+void Triangulation<T, TNearPointLocator>::peelLayer(
     std::stack<TriInd> seeds,
     const LayerDepth layerDepth,
-    std::vector<LayerDepth>& triDepths) const
+    std::vector<LayerDepth>& triDepths,
+    std::vector<std::vector<TriInd> >& seedsByDepth) const
 {
-    unordered_map<TriInd, LayerDepth> behindBoundary;
     while(!seeds.empty())
     {
         const TriInd iT = seeds.top();
         seeds.pop();
         triDepths[iT] = std::min(triDepths[iT], layerDepth);
-        behindBoundary.erase(iT);
         const Triangle& t = triangles[iT];
         for(Index i(0); i < Index(3); ++i)
         {
@@ -1758,13 +1808,16 @@ Triangulation<T, TNearPointLocator>::peelLayer(
                 const LayerDepth triDepth = cit == overlapCount.end()
                                                 ? layerDepth + 1
                                                 : layerDepth + cit->second + 1;
-                behindBoundary[iN] = triDepth;
+                // seeds reached within this layer are skipped when their
+                // depth comes up, see calculateTriangleDepths
+                if(seedsByDepth.size() <= triDepth)
+                    seedsByDepth.resize(triDepth + 1);
+                seedsByDepth[triDepth].push_back(iN);
                 continue;
             }
             seeds.push(iN);
         }
     }
-    return behindBoundary;
 }
 
 template <typename T, typename TNearPointLocator>
@@ -1775,26 +1828,31 @@ Triangulation<T, TNearPointLocator>::calculateTriangleDepths() const
         triangles.size(), std::numeric_limits<LayerDepth>::max());
     std::stack<TriInd> seeds(TriDeque(1, m_vertTris[0]));
     LayerDepth layerDepth = 0;
-    LayerDepth deepestSeedDepth = 0;
 
-    unordered_map<LayerDepth, TriIndUSet> seedsByDepth;
+    // Candidate seeds per depth; a triangle may be listed several times or
+    // may have been reached by a shallower layer, which is filtered here
+    // instead of keeping a hash set per depth
+    std::vector<std::vector<TriInd> > seedsByDepth;
     do
     {
-        const unordered_map<TriInd, LayerDepth>& newSeeds =
-            peelLayer(seeds, layerDepth, triDepths);
+        peelLayer(seeds, layerDepth, triDepths, seedsByDepth);
 
-        seedsByDepth.erase(layerDepth);
-        typedef unordered_map<TriInd, LayerDepth>::const_iterator Iter;
-        for(Iter it = newSeeds.begin(); it != newSeeds.end(); ++it)
+        ++layerDepth;
+        TriDeque nextLayerSeeds;
+        if(layerDepth < seedsByDepth.size())
         {
-            deepestSeedDepth = std::max(deepestSeedDepth, it->second);
-            seedsByDepth[it->second].insert(it->first);
+            std::vector<TriInd>& candidates = seedsByDepth[layerDepth];
+            for(std::vector<TriInd>::const_iterator it = candidates.begin();
+                it != candidates.end();
+                ++it)
+            {
+                if(triDepths[*it] > layerDepth)
+                    nextLayerSeeds.push_back(*it);
+            }
+            std::vector<TriInd>().swap(candidates);
         }
-        const TriIndUSet& nextLayerSeeds = seedsByDepth[layerDepth + 1];
-        seeds = std::stack<TriInd>(
-            TriDeque(nextLayerSeeds.begin(), nextLayerSeeds.end()));
-        ++layerDepth;
-    } while(!seeds.empty() || deepestSeedDepth > layerDepth);
+        seeds = std::stack<TriInd>(nextLayerSeeds);
+    } while(!seeds.empty() || std::size_t(layerDepth) + 1 < seedsByDepth.size());
 
     return triDepths;
 }
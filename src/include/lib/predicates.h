@@ -33,6 +33,8 @@
 #ifndef PREDICATES_H_INCLUDED
 #define PREDICATES_H_INCLUDED
 
+#include <cstddef>//size_t
+
 //@reference: https://www.cs.cmu.edu/~quake/robust.html
 
 namespace  predicates {
@@ -163,6 +165,35 @@ namespace  predicates {
 		//@note    : positive, 0, negative result for d inside, on, or outside the circle defined by a, b, and c
 		template <typename T> T insphere(T const*const pa, T const*const pb, T const*const pc, T const*const pd, T const*const pe);
 	}
+
+	//@brief: adaptive 2d predicates evaluated for many independent inputs at once
+	//@note : the floating point filter runs on several inputs per instruction (AVX2 or AVX-512, chosen at runtime) and only the
+	//        inputs it can't decide go through the scalar adaptive routines, so every result is identical to the adaptive one
+	namespace batched {
+		//@brief    : determine for each i if the 2d point c[i] is above, on, or below the line defined by a[i] and b[i]
+		//@param n  : number of inputs
+		//@param ax : X-coordinates of a
+		//@param ay : Y-coordinates of a
+		//@param bx : X-coordinates of b
+		//@param by : Y-coordinates of b
+		//@param cx : X-coordinates of c
+		//@param cy : Y-coordinates of c
+		//@param out: n results, adaptive::orient2d(ax[i], ay[i], bx[i], by[i], cx[i], cy[i])
+		template <typename T> void orient2d(size_t n, T const*const ax, T const*const ay, T const*const bx, T const*const by, T const*const cx, T const*const cy, T*const out);
+
+		//@brief    : determine for each i if the 2d point d[i] is inside, on, or outside the circle defined by a[i], b[i], and c[i]
+		//@param n  : number of inputs
+		//@param ax : X-coordinates of a
+		//@param ay : Y-coordinates of a
+		//@param bx : X-coordinates of b
+		//@param by : Y-coordinates of b
+		//@param cx : X-coordinates of c
+		//@param cy : Y-coordinates of c
+		//@param dx : X-coordinates of d
+		//@param dy : Y-coordinates of d
+		//@param out: n results, adaptive::incircle(ax[i], ay[i], bx[i], by[i], cx[i], cy[i], dx[i], dy[i])
+		template <typename T> void incircle(size_t n, T const*const ax, T const*const ay, T const*const bx, T const*const by, T const*const cx, T const*const cy, T const*const dx, T const*const dy, T*const out);
+	}
 }
 
 #include <cmath>//abs, fma
@@ -910,6 +941,235 @@ namespace detail {
 			return exact::insphere(pa, pb, pc, pd, pe);
 		}
 	}
+
+	namespace batched {
+		template <typename T> void orient2d(size_t n, T const*const ax, T const*const ay, T const*const bx, T const*const by, T const*const cx, T const*const cy, T*const out) {
+			for(size_t i = 0; i < n; ++i) out[i] = adaptive::orient2d(ax[i], ay[i], bx[i], by[i], cx[i], cy[i]);
+		}
+
+		template <typename T> void incircle(size_t n, T const*const ax, T const*const ay, T const*const bx, T const*const by, T const*const cx, T const*const cy, T const*const dx, T const*const dy, T*const out) {
+			for(size_t i = 0; i < n; ++i) out[i] = adaptive::incircle(ax[i], ay[i], bx[i], by[i], cx[i], cy[i], dx[i], dy[i]);
+		}
+	}
+}
+
+// The vector filters must round exactly like the scalar ones: only x86-64 (SSE2 scalar math, no x87 excess precision) without
+// FMA in the baseline (so the compiler can't contract the scalar filter) qualifies. Define PREDICATES_NO_SIMD to opt out.
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) && !defined(__FMA__) && !defined(PREDICATES_NO_SIMD)
+#define PREDICATES_BATCHED_SIMD 1
+#endif
+
+#ifdef PREDICATES_BATCHED_SIMD
+#include <immintrin.h>
+
+namespace predicates {
+namespace detail {
+	enum SimdLevel { SimdNone, SimdAVX2, SimdAVX512 };
+
+	//@brief : widest vector instruction set of the running CPU, detected once
+	inline SimdLevel simdLevel() {
+		static const SimdLevel level = __builtin_cpu_supports("avx512f") ? SimdAVX512 : __builtin_cpu_supports("avx2") ? SimdAVX2 : SimdNone;
+		return level;
+	}
+
+	//@brief : number of inputs the filters of a level take at once, 0 for none
+	inline size_t simdWidth(const SimdLevel level) {
+		return SimdAVX512 == level ? 8 : SimdAVX2 == level ? 4 : 0;
+	}
+
+	//@brief    : stage one of adaptive::orient2d on 4 inputs
+	//@return   : bit i set if the filter decided input i; out[i] is then the adaptive result
+	__attribute__((target("avx2"))) inline int orient2dFilterAVX2(double const*const ax, double const*const ay, double const*const bx, double const*const by, double const*const cx, double const*const cy, double*const out) {
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d signMask = _mm256_set1_pd(-0.0);
+		const __m256d vcx = _mm256_loadu_pd(cx);
+		const __m256d vcy = _mm256_loadu_pd(cy);
+		const __m256d acx = _mm256_sub_pd(_mm256_loadu_pd(ax), vcx);
+		const __m256d bcx = _mm256_sub_pd(_mm256_loadu_pd(bx), vcx);
+		const __m256d acy = _mm256_sub_pd(_mm256_loadu_pd(ay), vcy);
+		const __m256d bcy = _mm256_sub_pd(_mm256_loadu_pd(by), vcy);
+		const __m256d detleft = _mm256_mul_pd(acx, bcy);
+		const __m256d detright = _mm256_mul_pd(acy, bcx);
+		const __m256d det = _mm256_sub_pd(detleft, detright);
+		const __m256d signsDiffer = _mm256_xor_pd(_mm256_cmp_pd(detleft, zero, _CMP_LT_OQ), _mm256_cmp_pd(detright, zero, _CMP_LT_OQ));
+		const __m256d anyZero = _mm256_or_pd(_mm256_cmp_pd(detleft, zero, _CMP_EQ_OQ), _mm256_cmp_pd(detright, zero, _CMP_EQ_OQ));
+		const __m256d detsum = _mm256_andnot_pd(signMask, _mm256_add_pd(detleft, detright));
+		const __m256d errbound = _mm256_mul_pd(_mm256_set1_pd(Constants<double>::ccwerrboundA), detsum);
+		const __m256d bounded = _mm256_cmp_pd(_mm256_andnot_pd(signMask, det), errbound, _CMP_GE_OQ);
+		_mm256_storeu_pd(out, det);
+		return _mm256_movemask_pd(_mm256_or_pd(_mm256_or_pd(signsDiffer, anyZero), bounded));
+	}
+
+	// AVX-512F implies FMA, so plain vector arithmetic could be contracted into fused operations that round differently
+	// from the scalar filter; the explicit rounding forms are never contracted.
+#define PREDICATES_MM512_MUL(a, b) _mm512_maskz_mul_round_pd(__mmask8(0xFF), a, b, _MM_FROUND_CUR_DIRECTION)
+#define PREDICATES_MM512_ADD(a, b) _mm512_maskz_add_round_pd(__mmask8(0xFF), a, b, _MM_FROUND_CUR_DIRECTION)
+#define PREDICATES_MM512_SUB(a, b) _mm512_maskz_sub_round_pd(__mmask8(0xFF), a, b, _MM_FROUND_CUR_DIRECTION)
+
+	//@brief    : stage one of adaptive::orient2d on 8 inputs
+	//@return   : bit i set if the filter decided input i; out[i] is then the adaptive result
+	__attribute__((target("avx512f"))) inline int orient2dFilterAVX512(double const*const ax, double const*const ay, double const*const bx, double const*const by, double const*const cx, double const*const cy, double*const out) {
+		const __m512d zero = _mm512_setzero_pd();
+		const __m512d vcx = _mm512_loadu_pd(cx);
+		const __m512d vcy = _mm512_loadu_pd(cy);
+		const __m512d acx = PREDICATES_MM512_SUB(_mm512_loadu_pd(ax), vcx);
+		const __m512d bcx = PREDICATES_MM512_SUB(_mm512_loadu_pd(bx), vcx);
+		const __m512d acy = PREDICATES_MM512_SUB(_mm512_loadu_pd(ay), vcy);
+		const __m512d bcy = PREDICATES_MM512_SUB(_mm512_loadu_pd(by), vcy);
+		const __m512d detleft = PREDICATES_MM512_MUL(acx, bcy);
+		const __m512d detright = PREDICATES_MM512_MUL(acy, bcx);
+		const __m512d det = PREDICATES_MM512_SUB(detleft, detright);
+		const __mmask8 signsDiffer = _mm512_cmp_pd_mask(detleft, zero, _CMP_LT_OQ) ^ _mm512_cmp_pd_mask(detright, zero, _CMP_LT_OQ);
+		const __mmask8 anyZero = _mm512_cmp_pd_mask(detleft, zero, _CMP_EQ_OQ) | _mm512_cmp_pd_mask(detright, zero, _CMP_EQ_OQ);
+		const __m512d detsum = _mm512_abs_pd(PREDICATES_MM512_ADD(detleft, detright));
+		const __m512d errbound = PREDICATES_MM512_MUL(_mm512_set1_pd(Constants<double>::ccwerrboundA), detsum);
+		const __mmask8 bounded = _mm512_cmp_pd_mask(_mm512_abs_pd(det), errbound, _CMP_GE_OQ);
+		_mm512_storeu_pd(out, det);
+		return signsDiffer | anyZero | bounded;
+	}
+
+	//@brief    : stage one of adaptive::incircle on 4 inputs
+	//@return   : bit i set if the filter decided input i; out[i] is then the adaptive result
+	__attribute__((target("avx2"))) inline int incircleFilterAVX2(double const*const ax, double const*const ay, double const*const bx, double const*const by, double const*const cx, double const*const cy, double const*const dx, double const*const dy, double*const out) {
+		const __m256d signMask = _mm256_set1_pd(-0.0);
+		const __m256d vdx = _mm256_loadu_pd(dx);
+		const __m256d vdy = _mm256_loadu_pd(dy);
+		const __m256d adx = _mm256_sub_pd(_mm256_loadu_pd(ax), vdx);
+		const __m256d bdx = _mm256_sub_pd(_mm256_loadu_pd(bx), vdx);
+		const __m256d cdx = _mm256_sub_pd(_mm256_loadu_pd(cx), vdx);
+		const __m256d ady = _mm256_sub_pd(_mm256_loadu_pd(ay), vdy);
+		const __m256d bdy = _mm256_sub_pd(_mm256_loadu_pd(by), vdy);
+		const __m256d cdy = _mm256_sub_pd(_mm256_loadu_pd(cy), vdy);
+		const __m256d bdxcdy = _mm256_mul_pd(bdx, cdy);
+		const __m256d cdxbdy = _mm256_mul_pd(cdx, bdy);
+		const __m256d cdxady = _mm256_mul_pd(cdx, ady);
+		const __m256d adxcdy = _mm256_mul_pd(adx, cdy);
+		const __m256d adxbdy = _mm256_mul_pd(adx, bdy);
+		const __m256d bdxady = _mm256_mul_pd(bdx, ady);
+		const __m256d alift = _mm256_add_pd(_mm256_mul_pd(adx, adx), _mm256_mul_pd(ady, ady));
+		const __m256d blift = _mm256_add_pd(_mm256_mul_pd(bdx, bdx), _mm256_mul_pd(bdy, bdy));
+		const __m256d clift = _mm256_add_pd(_mm256_mul_pd(cdx, cdx), _mm256_mul_pd(cdy, cdy));
+		const __m256d det = _mm256_add_pd(_mm256_add_pd(
+		                        _mm256_mul_pd(alift, _mm256_sub_pd(bdxcdy, cdxbdy)),
+		                        _mm256_mul_pd(blift, _mm256_sub_pd(cdxady, adxcdy))),
+		                        _mm256_mul_pd(clift, _mm256_sub_pd(adxbdy, bdxady)));
+		const __m256d permanent = _mm256_add_pd(_mm256_add_pd(
+		                              _mm256_mul_pd(_mm256_add_pd(_mm256_andnot_pd(signMask, bdxcdy), _mm256_andnot_pd(signMask, cdxbdy)), alift),
+		                              _mm256_mul_pd(_mm256_add_pd(_mm256_andnot_pd(signMask, cdxady), _mm256_andnot_pd(signMask, adxcdy)), blift)),
+		                              _mm256_mul_pd(_mm256_add_pd(_mm256_andnot_pd(signMask, adxbdy), _mm256_andnot_pd(signMask, bdxady)), clift));
+		const __m256d errbound = _mm256_mul_pd(_mm256_set1_pd(Constants<double>::iccerrboundA), permanent);
+		_mm256_storeu_pd(out, det);
+		return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_andnot_pd(signMask, det), _mm256_andnot_pd(signMask, errbound), _CMP_GE_OQ));
+	}
+
+	//@brief    : stage one of adaptive::incircle on 8 inputs
+	//@return   : bit i set if the filter decided input i; out[i] is then the adaptive result
+	__attribute__((target("avx512f"))) inline int incircleFilterAVX512(double const*const ax, double const*const ay, double const*const bx, double const*const by, double const*const cx, double const*const cy, double const*const dx, double const*const dy, double*const out) {
+		const __m512d vdx = _mm512_loadu_pd(dx);
+		const __m512d vdy = _mm512_loadu_pd(dy);
+		const __m512d adx = PREDICATES_MM512_SUB(_mm512_loadu_pd(ax), vdx);
+		const __m512d bdx = PREDICATES_MM512_SUB(_mm512_loadu_pd(bx), vdx);
+		const __m512d cdx = PREDICATES_MM512_SUB(_mm512_loadu_pd(cx), vdx);
+		const __m512d ady = PREDICATES_MM512_SUB(_mm512_loadu_pd(ay), vdy);
+		const __m512d bdy = PREDICATES_MM512_SUB(_mm512_loadu_pd(by), vdy);
+		const __m512d cdy = PREDICATES_MM512_SUB(_mm512_loadu_pd(cy), vdy);
+		const __m512d bdxcdy = PREDICATES_MM512_MUL(bdx, cdy);
+		const __m512d cdxbdy = PREDICATES_MM512_MUL(cdx, bdy);
+		const __m512d cdxady = PREDICATES_MM512_MUL(cdx, ady);
+		const __m512d adxcdy = PREDICATES_MM512_MUL(adx, cdy);
+		const __m512d adxbdy = PREDICATES_MM512_MUL(adx, bdy);
+		const __m512d bdxady = PREDICATES_MM512_MUL(bdx, ady);
+		const __m512d alift = PREDICATES_MM512_ADD(PREDICATES_MM512_MUL(adx, adx), PREDICATES_MM512_MUL(ady, ady));
+		const __m512d blift = PREDICATES_MM512_ADD(PREDICATES_MM512_MUL(bdx, bdx), PREDICATES_MM512_MUL(bdy, bdy));
+		const __m512d clift = PREDICATES_MM512_ADD(PREDICATES_MM512_MUL(cdx, cdx), PREDICATES_MM512_MUL(cdy, cdy));
+		const __m512d det = PREDICATES_MM512_ADD(PREDICATES_MM512_ADD(
+		                        PREDICATES_MM512_MUL(alift, PREDICATES_MM512_SUB(bdxcdy, cdxbdy)),
+		                        PREDICATES_MM512_MUL(blift, PREDICATES_MM512_SUB(cdxady, adxcdy))),
+		                        PREDICATES_MM512_MUL(clift, PREDICATES_MM512_SUB(adxbdy, bdxady)));
+		const __m512d permanent = PREDICATES_MM512_ADD(PREDICATES_MM512_ADD(
+		                              PREDICATES_MM512_MUL(PREDICATES_MM512_ADD(_mm512_abs_pd(bdxcdy), _mm512_abs_pd(cdxbdy)), alift),
+		                              PREDICATES_MM512_MUL(PREDICATES_MM512_ADD(_mm512_abs_pd(cdxady), _mm512_abs_pd(adxcdy)), blift)),
+		                              PREDICATES_MM512_MUL(PREDICATES_MM512_ADD(_mm512_abs_pd(adxbdy), _mm512_abs_pd(bdxady)), clift));
+		const __m512d errbound = PREDICATES_MM512_MUL(_mm512_set1_pd(Constants<double>::iccerrboundA), permanent);
+		_mm512_storeu_pd(out, det);
+		return _mm512_cmp_pd_mask(_mm512_abs_pd(det), _mm512_abs_pd(errbound), _CMP_GE_OQ);
+	}
+
+	//@brief   : run the orient2d filter of a level on one block of inputs
+	inline int orient2dFilter(const SimdLevel level, double const*const ax, double const*const ay, double const*const bx, double const*const by, double const*const cx, double const*const cy, double*const out) {
+		return SimdAVX512 == level ? orient2dFilterAVX512(ax, ay, bx, by, cx, cy, out) : orient2dFilterAVX2(ax, ay, bx, by, cx, cy, out);
+	}
+
+	//@brief   : run the incircle filter of a level on one block of inputs
+	inline int incircleFilter(const SimdLevel level, double const*const ax, double const*const ay, double const*const bx, double const*const by, double const*const cx, double const*const cy, double const*const dx, double const*const dy, double*const out) {
+		return SimdAVX512 == level ? incircleFilterAVX512(ax, ay, bx, by, cx, cy, dx, dy, out) : incircleFilterAVX2(ax, ay, bx, by, cx, cy, dx, dy, out);
+	}
+
+}
+
+	namespace batched {
+		template <> inline void orient2d<double>(size_t n, double const*const ax, double const*const ay, double const*const bx, double const*const by, double const*const cx, double const*const cy, double*const out) {
+			const detail::SimdLevel level = detail::simdLevel();
+			size_t i = 0;
+			// full blocks at the widest level, then AVX2 blocks (supported whenever AVX-512 is) for what's left
+			for(detail::SimdLevel l = level; l != detail::SimdNone; l = detail::SimdAVX512 == l ? detail::SimdAVX2 : detail::SimdNone) {
+				const size_t width = detail::simdWidth(l);
+				for(; i + width <= n; i += width) {
+					const int decided = detail::orient2dFilter(l, ax + i, ay + i, bx + i, by + i, cx + i, cy + i, out + i);
+					for(size_t j = i; j < i + width; ++j) {
+						if(!(decided & (1 << (j - i)))) out[j] = adaptive::orient2d(ax[j], ay[j], bx[j], by[j], cx[j], cy[j]);
+					}
+				}
+			}
+			// pad a last partial block with zeros, which the filter decides trivially
+			const size_t rest = n - i;
+			if(detail::SimdNone != level && rest > 1) {
+				double in[6][4] = {};
+				double det[4];
+				for(size_t j = 0; j < rest; ++j) {
+					in[0][j] = ax[i + j]; in[1][j] = ay[i + j]; in[2][j] = bx[i + j]; in[3][j] = by[i + j]; in[4][j] = cx[i + j]; in[5][j] = cy[i + j];
+				}
+				const int decided = detail::orient2dFilterAVX2(in[0], in[1], in[2], in[3], in[4], in[5], det);
+				for(size_t j = 0; j < rest; ++j) {
+					out[i + j] = decided & (1 << j) ? det[j] : adaptive::orient2d(ax[i + j], ay[i + j], bx[i + j], by[i + j], cx[i + j], cy[i + j]);
+				}
+				return;
+			}
+			for(; i < n; ++i) out[i] = adaptive::orient2d(ax[i], ay[i], bx[i], by[i], cx[i], cy[i]);
+		}
+
+		template <> inline void incircle<double>(size_t n, double const*const ax, double const*const ay, double const*const bx, double const*const by, double const*const cx, double const*const cy, double const*const dx, double const*const dy, double*const out) {
+			const detail::SimdLevel level = detail::simdLevel();
+			size_t i = 0;
+			// full blocks at the widest level, then AVX2 blocks (supported whenever AVX-512 is) for what's left
+			for(detail::SimdLevel l = level; l != detail::SimdNone; l = detail::SimdAVX512 == l ? detail::SimdAVX2 : detail::SimdNone) {
+				const size_t width = detail::simdWidth(l);
+				for(; i + width <= n; i += width) {
+					const int decided = detail::incircleFilter(l, ax + i, ay + i, bx + i, by + i, cx + i, cy + i, dx + i, dy + i, out + i);
+					for(size_t j = i; j < i + width; ++j) {
+						if(!(decided & (1 << (j - i)))) out[j] = adaptive::incircle(ax[j], ay[j], bx[j], by[j], cx[j], cy[j], dx[j], dy[j]);
+					}
+				}
+			}
+			// pad a last partial block with zeros, which the filter decides trivially
+			const size_t rest = n - i;
+			if(detail::SimdNone != level && rest > 1) {
+				double in[8][4] = {};
+				double det[4];
+				for(size_t j = 0; j < rest; ++j) {
+					in[0][j] = ax[i + j]; in[1][j] = ay[i + j]; in[2][j] = bx[i + j]; in[3][j] = by[i + j];
+					in[4][j] = cx[i + j]; in[5][j] = cy[i + j]; in[6][j] = dx[i + j]; in[7][j] = dy[i + j];
+				}
+				const int decided = detail::incircleFilterAVX2(in[0], in[1], in[2], in[3], in[4], in[5], in[6], in[7], det);
+				for(size_t j = 0; j < rest; ++j) {
+					out[i + j] = decided & (1 << j) ? det[j] : adaptive::incircle(ax[i + j], ay[i + j], bx[i + j], by[i + j], cx[i + j], cy[i + j], dx[i + j], dy[i + j]);
+				}
+				return;
+			}
+			for(; i < n; ++i) out[i] = adaptive::incircle(ax[i], ay[i], bx[i], by[i], cx[i], cy[i], dx[i], dy[i]);
+		}
+	}
 }
+#endif // PREDICATES_BATCHED_SIMD
 
 #endif
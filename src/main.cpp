@@ -1,29 +1,382 @@
 // main.cpp
 
 #include "include/GDSProcessor.h"
+#include "include/CellHierarchy.h"
+#include "include/GDSStreamReader.h"
+#include "include/PipelineStats.h"
+#include "include/ProcessStack.h"
+#include "include/SpatialIndex.h"
+#include "include/TriangulationCache.h"
+#ifdef GDS_WITH_OPENVDB
+#include "include/LevelSet.h"
+#include <memory>
+#include <type_traits>
+#endif
+
+void printUsage(const char* programName) {
+    cerr << "Usage: " << programName << " [--threads N] [--format ascii|binary] [--no-fast-paths] [--regions] [--cache] [--cache-file FILE] [--hierarchy | --stream | --db-units] [--window XMIN,YMIN,XMAX,YMAX [--clip]] [--stats] [--stats-json FILE] [--streams N] [--stack FILE] [--vdb FILE [--vdb-union] [--voxel-size V] [--band W]] <GDS file>" << endl;
+    cerr << "  --threads N      triangulate with N threads (0 = all cores, default 1)" << endl;
+    cerr << "  --format FORMAT  PLY encoding, ascii or binary (default binary)" << endl;
+    cerr << "  --no-fast-paths  send every polygon through the constrained Delaunay triangulation" << endl;
+    cerr << "  --regions        triangulate touching polygons of a layer together as their union (not with --stream)" << endl;
+    cerr << "  --cache          reuse triangulations of shapes repeated at different offsets" << endl;
+    cerr << "  --cache-file F   like --cache, loading and saving the cache in F across runs" << endl;
+    cerr << "  --hierarchy      process each cell once and expand SREF/AREF placements while writing" << endl;
+    cerr << "  --stream         read through the built-in memory-mapped reader, triangulating and writing while parsing" << endl;
+    cerr << "  --db-units       keep coordinates as integer database units until the PLY is written (not with --window or --vdb)" << endl;
+    cerr << "  --window W       keep only polygons meeting the window XMIN,YMIN,XMAX,YMAX (user units, not with --hierarchy)" << endl;
+    cerr << "                   only --stream skips cells placed outside the window unread, the other modes read" << endl;
+    cerr << "                   and flatten the whole layout before dropping polygons outside it" << endl;
+    cerr << "  --clip           with --window, clip polygons crossing the window border" << endl;
+    cerr << "  --streams N      write up to N layer files at once (0 = all cores, default: --threads, not with --stream)" << endl;
+    cerr << "  --stack FILE     extrude each layer at the height given by a process stack file" << endl;
+    cerr << "                   (lines of: layer[/datatype] material z-bottom|- thickness)" << endl;
+#ifdef GDS_WITH_OPENVDB
+    cerr << "  --vdb FILE       write one narrow-band level set per layer to FILE instead of PLY meshes (flat modes)" << endl;
+    cerr << "  --vdb-union      write the union of all layers as a single level set named mask" << endl;
+    cerr << "  --voxel-size V   level set voxel size in user units (default 0.01)" << endl;
+    cerr << "  --band W         narrow band half width in voxels (default 3)" << endl;
+#endif
+    cerr << "  --stats          print per-stage time and peak memory, and per-layer counters" << endl;
+    cerr << "  --stats-json F   write the same statistics to F as JSON" << endl;
+}
+
+void printTriangulationStats(const TriangulationStats& stats, const TriangulationCache* cache) {
+    cout << "Triangulated " << stats.total() << " polygons: " << stats.rectangle << " rectangle, "
+         << stats.convex << " convex, " << stats.rectilinear << " rectilinear, " << stats.cdt << " CDT";
+    if (stats.region) {
+        cout << ", " << stats.region << " in regions";
+    }
+    cout << endl;
+    if (cache) {
+        size_t lookups = stats.cacheHits + stats.cacheMisses;
+        cout << "Triangulation cache: " << stats.cacheHits << " hits / " << lookups << " lookups ("
+             << (lookups ? 100.0 * stats.cacheHits / lookups : 0.0) << "% hit rate), " << cache->size() << " shapes" << endl;
+    }
+}
+
+// Vertex counts per layer, used to start writing the largest files first
+template <typename VertexT>
+map<int, size_t> layerSizes(const map<int, BasicPrismList<VertexT>>& layerMap3D) {
+    map<int, size_t> sizes;
+    for (const auto& layer : layerMap3D) {
+        sizes[layer.first] = layer.second.vertexCount();
+    }
+    return sizes;
+}
+
+map<int, size_t> layerSizes(const CellHierarchy& hierarchy) {
+    map<int, size_t> sizes;
+    for (int layerNumber : hierarchy.layers()) {
+        size_t& size = sizes[layerNumber];
+        forEachPlacement(hierarchy, layerNumber, [&size](const PrismList& prisms, const Transform2D&) {
+            size += prisms.vertexCount();
+        });
+    }
+    return sizes;
+}
+
+void countBytesWritten(PipelineStats* profile, const map<int, size_t>& bytesWritten) {
+    if (profile) {
+        for (const auto& layer : bytesWritten) {
+            profile->countBytesWritten(layer.first, layer.second);
+        }
+    }
+}
+
+// Parses "xmin,ymin,xmax,ymax"
+bool parseWindow(const char* text, BoundingBox& window) {
+    char trailing;
+    if (sscanf(text, "%lf,%lf,%lf,%lf%c", &window.xMin, &window.yMin, &window.xMax, &window.yMax, &trailing) != 4) {
+        return false;
+    }
+    return window.xMin <= window.xMax && window.yMin <= window.yMax;
+}
 
 int main(int argc, char* argv[]) {
 
-    if (argc != 2) {
-        cerr << "Usage: " << argv[0] << " <GDS file>" << endl;
+    const char* gdsFileName = nullptr;
+    TriangulationOptions triangulationOptions;
+    bool useCache = false;
+    string cacheFileName;
+    bool hierarchical = false;
+    bool streaming = false;
+    bool databaseUnits = false;
+    BoundingBox window;
+    bool windowed = false;
+    bool clip = false;
+    bool printStats = false;
+    int maxStreams = -1;
+    string statsFileName;
+    string stackFileName;
+    string vdbFileName;
+#ifdef GDS_WITH_OPENVDB
+    LevelSetOptions levelSetOptions;
+    bool vdbUnion = false;
+#endif
+    PLYFormat plyFormat = PLYFormat::Binary;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            triangulationOptions.numThreads = atoi(argv[++i]);
+        } else if (arg == "--format" && i + 1 < argc) {
+            string format = argv[++i];
+            if (format == "ascii") {
+                plyFormat = PLYFormat::Ascii;
+            } else if (format == "binary") {
+                plyFormat = PLYFormat::Binary;
+            } else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--no-fast-paths") {
+            triangulationOptions.fastPaths = false;
+        } else if (arg == "--regions") {
+            triangulationOptions.regions = true;
+        } else if (arg == "--cache") {
+            useCache = true;
+        } else if (arg == "--cache-file" && i + 1 < argc) {
+            useCache = true;
+            cacheFileName = argv[++i];
+        } else if (arg == "--hierarchy") {
+            hierarchical = true;
+        } else if (arg == "--stream") {
+            streaming = true;
+        } else if (arg == "--db-units") {
+            databaseUnits = true;
+        } else if (arg == "--window" && i + 1 < argc) {
+            if (!parseWindow(argv[++i], window)) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            windowed = true;
+        } else if (arg == "--clip") {
+            clip = true;
+        } else if (arg == "--streams" && i + 1 < argc) {
+            maxStreams = atoi(argv[++i]);
+        } else if (arg == "--stack" && i + 1 < argc) {
+            stackFileName = argv[++i];
+#ifdef GDS_WITH_OPENVDB
+        } else if (arg == "--vdb" && i + 1 < argc) {
+            vdbFileName = argv[++i];
+        } else if (arg == "--vdb-union") {
+            vdbUnion = true;
+        } else if (arg == "--voxel-size" && i + 1 < argc) {
+            levelSetOptions.voxelSize = atof(argv[++i]);
+        } else if (arg == "--band" && i + 1 < argc) {
+            levelSetOptions.halfWidth = static_cast<float>(atof(argv[++i]));
+#endif
+        } else if (arg == "--stats") {
+            printStats = true;
+        } else if (arg == "--stats-json" && i + 1 < argc) {
+            statsFileName = argv[++i];
+        } else if (arg[0] != '-' && gdsFileName == nullptr) {
+            gdsFileName = argv[i];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (gdsFileName == nullptr || (hierarchical && (streaming || windowed || !vdbFileName.empty())) || (clip && !windowed) ||
+        (streaming && triangulationOptions.regions) ||
+        (databaseUnits && (hierarchical || streaming || windowed || !vdbFileName.empty()))) {
+        printUsage(argv[0]);
+        return 1;
+    }
+#ifdef GDS_WITH_OPENVDB
+    if (vdbUnion && vdbFileName.empty()) {
+        printUsage(argv[0]);
         return 1;
     }
+#endif
+
+    // Without a stack every layer keeps the single 0..100 slab and its LayerN.ply name
+    ProcessStack stack;
+    bool useStack = !stackFileName.empty();
+    if (useStack) {
+        stack = readProcessStack(stackFileName);
+        if (stack.usesDatatypes() && !streaming) {
+            cerr << "Process stack layers with a datatype need --stream, the other readers merge datatypes" << endl;
+            return 1;
+        }
+    }
+    auto layerName = [&](int key) {
+        return useStack ? stack.layerName(key) : "Layer" + to_string(key);
+    };
+    auto plyFileName = [&](int key) {
+        return layerName(key) + ".ply";
+    };
+    auto extrudeLayers = [&](auto& layerMap) {
+        return useStack ? extrudeStack(layerMap, stack) : extrudePolygons(layerMap, 0.0, 100.0);
+    };
+
+    if (maxStreams < 0) {
+        maxStreams = triangulationOptions.numThreads;
+    }
+
+    // Database-unit shapes are keyed on the exact integer grid
+    TriangulationCache cache(databaseUnits ? 1.0 : 1e-6);
+    if (useCache) {
+        if (!cacheFileName.empty()) {
+            cache.load(cacheFileName);
+        }
+        triangulationOptions.cache = &cache;
+    }
+
+    PipelineStats pipelineStats;
+    PipelineStats* profile = printStats || !statsFileName.empty() ? &pipelineStats : nullptr;
+
+    // Separate .ply for each layer, or all layers as level sets in one .vdb.
+    // Level sets are only built from user-unit prisms.
+    auto writeLayers = [&](const auto& layerMap3D) {
+#ifdef GDS_WITH_OPENVDB
+        if constexpr (is_same<decay_t<decltype(layerMap3D)>, map<int, PrismList>>::value) {
+            if (!vdbFileName.empty()) {
+                openvdb::initialize();
+                openvdb::GridPtrVec grids;
+                if (vdbUnion) {
+                    openvdb::FloatGrid::Ptr mask = timed(profile, "levelSets", [&] { return layersToMask(layerMap3D, levelSetOptions); });
+                    if (mask) {
+                        mask->setName("mask");
+                        grids.push_back(mask);
+                    }
+                } else {
+                    grids = timed(profile, "levelSets", [&] { return layersToLevelSets(layerMap3D, layerName, levelSetOptions); });
+                }
+                timed(profile, "writeVDB", [&] { openvdb::io::File(vdbFileName).write(grids); });
+                return;
+            }
+        }
+#endif
+        StageTimer timer(profile, "writePLY");
+        map<int, size_t> bytesWritten = writeLayersConcurrently(layerSizes(layerMap3D), [&](int layerNumber) {
+            return writePLY(plyFileName(layerNumber), layerMap3D, layerNumber, plyFormat);
+        }, maxStreams);
+        countBytesWritten(profile, bytesWritten);
+    };
+
+    // Flat pipeline from the element lists on, in user or database units
+    auto processLayers = [&](auto& layerMap) {
+        if (useStack) {
+            layerMap = assignStackLayers(layerMap, stack);
+        }
+        TriangulationStats stats = timed(profile, "triangulatePolygons", [&] { return triangulatePolygons(layerMap, triangulationOptions); });
+        printTriangulationStats(stats, triangulationOptions.cache);
+        if (profile) {
+            for (const auto& layer : layerMap) {
+                profile->countElements(layer.first, layer.second);
+            }
+        }
 
-    const char* gdsFileName = argv[1];
-    GDSIIData* gdsIIData = readGDS(gdsFileName);
-    map<int, PolygonList> layerPLMap = extractPolygons(gdsIIData);
-    map<int, ElementList2D> layerMap = layerMapToElementList(layerPLMap);
-    triangulatePolygons(layerMap);
+        auto layerMap3D = timed(profile, "extrudePolygons", [&] { return extrudeLayers(layerMap); });
 
-    map<int, ElementList3D> layerMap3D = extrudePolygons(layerMap, 0.0, 100.0);
+        writeLayers(layerMap3D);
+    };
 
-    // Separate .ply for each layer
-    for (const auto& layer : layerMap3D) { 
-        string fileName = "Layer" + to_string(layer.first) + ".ply";
-        writePLY(fileName, layerMap3D, layer.first);
+    if (streaming && vdbFileName.empty()) {
+        // Each triangulated batch is extruded and appended to its layer's
+        // PLY records right away, so no layer is ever held whole
+        map<int, unique_ptr<PLYStreamWriter>> writers;
+        TriangulationStats stats = timed(profile, "streamTriangulate", [&] {
+            GDSStreamReader reader(gdsFileName);
+            return streamTriangulatedBatches(reader, triangulationOptions, [&](int key, ElementList2D& batch) {
+                if (profile) {
+                    profile->countElements(key, batch);
+                }
+                unique_ptr<PLYStreamWriter>& writer = writers[key];
+                if (!writer) {
+                    writer.reset(new PLYStreamWriter(plyFileName(key), plyFormat));
+                }
+                map<int, ElementList2D> batchMap;
+                batchMap[key] = move(batch);
+                for (const auto& layer : extrudeLayers(batchMap)) {
+                    writer->write(layer.second);
+                }
+            }, windowed ? &window : nullptr, clip, useStack ? &stack : nullptr);
+        });
+        printTriangulationStats(stats, triangulationOptions.cache);
+
+        StageTimer timer(profile, "writePLY");
+        map<int, size_t> bytesWritten;
+        for (auto& writer : writers) {
+            bytesWritten[writer.first] = writer.second->finish();
+        }
+        countBytesWritten(profile, bytesWritten);
+    } else if (streaming) {
+        TriangulationStats stats;
+        map<int, ElementList2D> layerMap = timed(profile, "streamTriangulate", [&] {
+            GDSStreamReader reader(gdsFileName);
+            return streamTriangulatedPolygons(reader, triangulationOptions, stats, windowed ? &window : nullptr, clip,
+                                              useStack ? &stack : nullptr);
+        });
+        printTriangulationStats(stats, triangulationOptions.cache);
+        if (profile) {
+            for (const auto& layer : layerMap) {
+                profile->countElements(layer.first, layer.second);
+            }
+        }
+
+        map<int, PrismList> layerMap3D = timed(profile, "extrudePolygons", [&] { return extrudeLayers(layerMap); });
+
+        writeLayers(layerMap3D);
+    } else {
+        GDSIIData* gdsIIData = timed(profile, "readGDS", [&] { return readGDS(gdsFileName); });
+        if (hierarchical) {
+            CellHierarchy hierarchy = timed(profile, "extractHierarchy", [&] { return extractHierarchy(gdsIIData); });
+            cout << "Hierarchy: " << hierarchy.cells.size() << " cells, " << hierarchy.uniquePolygonCount()
+                 << " unique polygons placed as " << hierarchy.placedPolygonCount() << endl;
+            if (useStack) {
+                assignStackLayers(hierarchy, stack);
+            }
+            TriangulationStats stats = timed(profile, "triangulateHierarchy", [&] { return triangulateHierarchy(hierarchy, triangulationOptions); });
+            printTriangulationStats(stats, triangulationOptions.cache);
+            if (profile) {
+                // Each cell is counted once, however often it is placed
+                for (const Cell& cell : hierarchy.cells) {
+                    for (const auto& layer : cell.layers) {
+                        profile->countElements(layer.first, layer.second);
+                    }
+                }
+            }
+
+            timed(profile, "extrudeHierarchy", [&] {
+                if (useStack) {
+                    extrudeStack(hierarchy, stack);
+                } else {
+                    extrudeHierarchy(hierarchy, 0.0, 100.0);
+                }
+            });
+
+            // Separate .ply for each layer
+            StageTimer timer(profile, "writePLY");
+            map<int, size_t> bytesWritten = writeLayersConcurrently(layerSizes(hierarchy), [&](int layerNumber) {
+                return writeHierarchyPLY(plyFileName(layerNumber), hierarchy, layerNumber, plyFormat);
+            }, maxStreams);
+            countBytesWritten(profile, bytesWritten);
+        } else if (databaseUnits) {
+            map<int, ElementListDB> layerMap = timed(profile, "extractPolygons", [&] { return extractElementListsDB(gdsIIData); });
+            processLayers(layerMap);
+        } else {
+            map<int, PolygonList> layerPLMap = timed(profile, "extractPolygons", [&] { return extractPolygons(gdsIIData); });
+            map<int, ElementList2D> layerMap;
+            if (windowed) {
+                layerMap = timed(profile, "extractWindow", [&] { return extractWindow(layerPLMap, window, clip); });
+            } else {
+                layerMap = timed(profile, "layerMapToElementList", [&] { return layerMapToElementList(layerPLMap); });
+            }
+            processLayers(layerMap);
+        }
+        delete gdsIIData;
+    }
+
+    if (!cacheFileName.empty()) {
+        cache.save(cacheFileName);
+    }
+    if (printStats) {
+        pipelineStats.printTable(cout);
+    }
+    if (!statsFileName.empty()) {
+        pipelineStats.writeJSON(statsFileName);
     }
-    
-    delete gdsIIData;
     return 0;
 }
-
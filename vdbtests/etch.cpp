@@ -1,41 +1,66 @@
 #include <openvdb/openvdb.h>
-#include <openvdb/tools/Composite.h>
+#include <iostream>
+#include <map>
+#include "CSG.h"
 
-int main() {
-    openvdb::initialize();
-    openvdb::io::File file1("cubeA.vdb");
-    openvdb::io::File file2("cubeB.vdb");
-    file1.open();
-    file2.open();
-
-    openvdb::GridBase::Ptr gridA_base = file1.readGrid("LevelSetCubeA");
-    openvdb::GridBase::Ptr gridB_base = file2.readGrid("LevelSetCubeB");
-    
-    file1.close();
-    file2.close();
-    
-    openvdb::FloatGrid::Ptr gridA = openvdb::gridPtrCast<openvdb::FloatGrid>(gridA_base);
-    openvdb::FloatGrid::Ptr gridB = openvdb::gridPtrCast<openvdb::FloatGrid>(gridB_base);
-    
-    openvdb::FloatGrid::ConstPtr
-    copyOfGridA = gridA->deepCopy(),
-    copyOfGridB = gridB->deepCopy();
-
-    openvdb::tools::csgUnion(*gridA, *gridB);
-    openvdb::io::File("cubeAUnion.vdb").write({gridA});
-    openvdb::io::File("cubeBUnion.vdb").write({gridB});
+// Loads every float grid of the given files by name
+static std::map<std::string, openvdb::FloatGrid::Ptr> readGrids(const std::vector<std::string>& fileNames) {
+    std::map<std::string, openvdb::FloatGrid::Ptr> grids;
+    for (const std::string& fileName : fileNames) {
+        openvdb::io::File file(fileName);
+        file.open();
+        for (const openvdb::GridBase::Ptr& grid : *file.getGrids()) {
+            if (openvdb::FloatGrid::Ptr floatGrid = openvdb::gridPtrCast<openvdb::FloatGrid>(grid)) {
+                grids[grid->getName()] = floatGrid;
+            }
+        }
+        file.close();
+    }
+    return grids;
+}
 
-    gridA = copyOfGridA->deepCopy();
-    gridB = copyOfGridB->deepCopy();
+// etch                               union, intersection and difference of the two cubes
+// etch EXPRESSION OUT.vdb FILE...    evaluate e.g. "(LevelSetCubeA | LevelSetCubeB) - Mask"
+int main(int argc, char* argv[]) {
+    openvdb::initialize();
 
-    openvdb::tools::csgIntersection(*gridA, *gridB);
-    openvdb::io::File("cubeAIntersect.vdb").write({gridA});
-    openvdb::io::File("cubeBIntersect.vdb").write({gridB});
+    if (argc > 1) {
+        if (argc < 4) {
+            std::cerr << "Usage: " << argv[0] << " [EXPRESSION OUT.vdb FILE.vdb...]" << std::endl;
+            return 1;
+        }
+        std::string error;
+        std::unique_ptr<CSGExpression> expression = parseCSGExpression(argv[1], error);
+        if (!expression) {
+            std::cerr << "bad expression: " << error << std::endl;
+            return 1;
+        }
+        std::map<std::string, openvdb::FloatGrid::Ptr> grids = readGrids(std::vector<std::string>(argv + 3, argv + argc));
+        std::vector<std::string> names;
+        csgGridNames(*expression, names);
+        for (const std::string& name : names) {
+            if (grids.count(name) == 0) {
+                std::cerr << "no grid named " << name << std::endl;
+                return 1;
+            }
+        }
+        openvdb::FloatGrid::Ptr result = evaluateCSG(*expression, [&](const std::string& name) { return grids[name]; });
+        result->setName("result");
+        openvdb::io::File(argv[2]).write({result});
+        return 0;
+    }
 
-    gridA = copyOfGridA->deepCopy();
-    gridB = copyOfGridB->deepCopy();
+    std::map<std::string, openvdb::FloatGrid::Ptr> grids = readGrids({"cubeA.vdb", "cubeB.vdb"});
+    const openvdb::FloatGrid& gridA = *grids.at("LevelSetCubeA");
+    const openvdb::FloatGrid& gridB = *grids.at("LevelSetCubeB");
 
-    openvdb::tools::csgDifference(*gridA, *gridB);
-    openvdb::io::File("cubeADifference.vdb").write({gridA});
-    openvdb::io::File("cubeBDifference.vdb").write({gridB});
+    // The copy variants leave both inputs intact, so nothing has to be backed up.
+    // Each result is written under A's name.
+    const char* operationNames[] = {"Union", "Intersect", "Difference"};
+    const CSGOperation operations[] = {CSGOperation::Union, CSGOperation::Intersection, CSGOperation::Difference};
+    for (int i = 0; i < 3; i++) {
+        openvdb::FloatGrid::Ptr result = csgCombine(operations[i], gridA, gridB);
+        result->setName(gridA.getName());
+        openvdb::io::File(std::string("cubeA") + operationNames[i] + ".vdb").write({result});
+    }
 }